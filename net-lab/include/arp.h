@@ -21,6 +21,12 @@ typedef struct arp_pkt
     uint8_t target_ip[NET_IP_LEN];   // 接收方协议地址
 } arp_pkt_t;
 
+typedef struct arp_key // arp表和arp buffer的键，同一ip在不同vlan上可能是不同的主机
+{
+    uint8_t ip[NET_IP_LEN]; // ip地址，放在最前面，打印时可以直接当作ip
+    uint16_t vid;           // 所在vlan，0为不带标签
+} arp_key_t;
+
 #pragma pack()
 
 void arp_init();
@@ -4,10 +4,12 @@
 #define ETHERNET
 #define ARP
 #define IP
+#define IPV6
 #define ICMP
 #define UDP
 #define TCP
 #define HTTP
+// #define LATENCY //各阶段延迟直方图，注释掉时相关代码完全不编译
 
 
 #ifdef TEST
@@ -19,6 +21,11 @@
     {                                      \
         0x11, 0x22, 0x33, 0x44, 0x55, 0x66 \
     } //测试用网卡mac地址
+#define NET_IF_IP6                                               \
+    {                                                            \
+        0xfd, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x03 \
+    } //测试用网卡ipv6地址
+#define TCP_TEST_ISS 0x10000000 //测试时固定的本端初始序号，输出的报文才能和demo比较
 #else
 #define NET_IF_IP    \
     {                   \
@@ -28,16 +35,78 @@
     {                                      \
         0x00, 0x11, 0x22, 0x33, 0x44, 0x55 \
     } //自定义网卡mac地址
+#define NET_IF_IP6                                               \
+    {                                                            \
+        0xfd, 0x00, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x14 \
+    } //自定义网卡ipv6地址
 #endif 
 
 
 
 #define ETHERNET_MAX_TRANSPORT_UNIT 1500 //以太网最大传输单元
+#define ETHERNET_MAX_JUMBO_UNIT 9000     //以太网巨型帧最大传输单元
+#define NET_IF_MTU ETHERNET_MAX_TRANSPORT_UNIT //网卡MTU初始值，运行时可用net_if_set_mtu修改
+#define NET_VLAN_MAX 4096                //vlan id上限（12位）
+#define NET_RX_BATCH 32                  //每次轮询最多处理的收包数，一批处理完后再统一发出ACK
 
 #define ARP_TIMEOUT_SEC (60 * 5) //arp表过期时间
 #define ARP_MIN_INTERVAL 1       //向相同地址发送arp请求的最小间隔
 
 #define IP_DEFALUT_TTL 64 //IP默认TTL
+#define IPV6_DEFAULT_HOP_LIMIT 64 //IPv6默认跳数限制
+
+#define ND_TIMEOUT_SEC (60 * 5) //邻居缓存过期时间
+#define ND_MIN_INTERVAL 1       //向相同地址发送邻居请求的最小间隔
+#define IP_PMTU_TIMEOUT_SEC (60 * 10) //路径MTU缓存过期时间，过期后重新探测更大的MTU
+#define IP_PMTU_CACHE_SIZE 256        //路径MTU缓存的槽数，直接映射，必须是2的幂
+#define IP_PMTU_MIN 576               //接受的最小路径MTU，防止伪造的ICMP把MTU压得过低
+#define IP_ID_BUCKET_NUM 256          //ip标识符计数器桶数，必须是2的幂
+#define CACHE_LINE_SIZE 64            //缓存行大小，用于避免多核伪共享
+
+#define LOG_LEVEL 1         //编译期日志级别，0调试 1信息 2警告 3错误 4关闭，低于该级别的日志不编译
+#define LOG_RING_LEN 4096   //日志环记录数，必须是2的幂
+#define LOG_DRAIN_BATCH 256 //主循环每轮最多输出的日志记录数
+
+#define EVENT_QUEUE_LEN 4096   //就绪事件队列长度，一次轮询中就绪的对象超过它时丢弃事件
+#define UDP_RCV_BUF_SIZE 65536 //没有处理程序的udp端口的数据报接收环大小，必须是2的幂
+
+#define STATS_CORE_NUM 4          //计数器行数，每个收发线程一行
+#define STATS_TEXT_MAX_LEN 1400   //计数器文本最大长度，保证一个udp数据报能装下
+#define STATS_PORT 0              //计数器查询udp端口，0为不开启（如60001）
+#define STATS_ALLOW_IP {127, 0, 0, 1} //除127.0.0.0/8外唯一允许查询计数器的源地址
+
+#define LATENCY_SUB_BUCKET_BITS 4         //直方图每个2的幂区间细分为2^4个桶，相对误差约3%
+#define LATENCY_CALIBRATE_NS (10 * 1000000) //校准TSC频率的时长
+
+#define TIMER_TICK_MS 10      //时间轮槽宽，毫秒
+#define TIMER_WHEEL_SIZE 512  //时间轮槽数，一圈约5秒，更远的定时器多转几圈
+
+#define TCP_RTO_INIT_MS 1000     //没有往返时间测量值时的初始重传超时
+#define TCP_RTO_MIN_MS 200       //重传超时下限
+#define TCP_RTO_MAX_MS 60000     //指数退避的重传超时上限
+#define TCP_RTX_MAX_RETRIES 8    //连续重传超过该次数则中止连接
+#define TCP_INIT_CWND 10         //初始拥塞窗口，报文段数（RFC 6928）
+#define TCP_DUPACK_THRESH 3      //触发快速重传的重复ACK数
+#define TCP_DELACK_MS 40         //延迟确认的最长时间，不应超过40毫秒
+#define TCP_CC_DEFAULT TCP_CC_CUBIC //新连接默认的拥塞控制算法
+#define TCP_SACKED_MAX 8         //每个连接最多记录的对端SACK区间数
+#define TCP_SYN_BACKLOG 128      //每个监听端口最多保存的半连接数，超出后改用SYN cookie
+#define TCP_SYN_COOKIE_WINDOW_MS 128000 //最后一次发出SYN cookie后接受cookie的时间，覆盖cookie有效的两个时间片
+#define TCP_ACCEPT_BACKLOG_MAX 128 //tcp_listen全连接队列容量的上限
+#define TCP_SYN_RETRIES 5        //半连接SYN+ACK的最大重传次数
+#define TCP_EPHEMERAL_MIN 49152  //主动打开时本地临时端口的范围（RFC 6335）
+#define TCP_EPHEMERAL_MAX 65535
+#define TCP_RCV_BUF_SIZE 131072  //每个连接的接收环大小，决定通告窗口的上限，必须是2的幂
+#define TCP_SND_BUF_SIZE 131072  //每个连接的发送环大小，必须是2的幂
+#define TCP_HASH_INIT_SIZE 1024  //连接哈希表的初始槽数，必须是2的幂，负载超过3/4时翻倍
+#define TCP_TIME_WAIT_MS 60000   //TIME_WAIT的持续时间（2MSL）
+#define TCP_TW_SLOTS 8           //回收TIME_WAIT记录的时间轮槽数，持续时间的误差不超过一个槽
+#define TCP_TW_MAX 65536         //TIME_WAIT记录数的上限，超出后主动关闭的连接直接释放
+#define TCP_KEEPALIVE_IDLE_MS 7200000 //新连接空闲多久后开始保活探测（RFC 1122：不少于两小时），0表示默认关闭
+#define TCP_KEEPALIVE_INTVL_MS 75000  //保活探测的间隔
+#define TCP_KEEPALIVE_PROBES 9        //连续多少次保活探测没有回应则中止连接
+#define TCP_FIN_WAIT2_MS 60000        //应用层关闭后，FIN_WAIT_2中对端空闲超过该时间则复位连接
+#define TCP_OOO_MAX 8            //每个连接最多记录的乱序区间数，数据本身直接放在接收缓存中
 
 #define BUF_MAX_LEN (2 * UINT16_MAX + UINT8_MAX) //buf最大长度
 
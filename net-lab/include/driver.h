@@ -7,6 +7,7 @@
 #define PCAP_BUF_SIZE 1024
 #endif
 int driver_open();
+int driver_update_filter();
 int driver_recv(buf_t *buf);
 int driver_send(buf_t *buf);
 void driver_close();
@@ -13,7 +13,16 @@ typedef struct ether_hdr
     uint8_t src[NET_MAC_LEN]; // 源mac地址
     uint16_t protocol16;      // 协议/长度
 } ether_hdr_t;
+
+typedef struct ether_vlan_tag
+{
+    uint16_t tci16;      // 优先级(3位)、DEI(1位)、vlan id(12位)
+    uint16_t protocol16; // 内层协议/长度
+} ether_vlan_tag_t;
 #pragma pack()
+
+#define ETHERNET_VLAN_ID_MASK 0x0FFF //tci中vlan id的掩码
+#define ETHERNET_TYPE_MIN 0x0600 //协议/长度字段不小于它时是以太网协议号，否则是802.3帧的长度
 void ethernet_init();
 void ethernet_in(buf_t *buf);
 void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol);
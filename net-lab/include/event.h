@@ -0,0 +1,32 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+#define EVENT_READABLE 0x01 // 有数据可读：TCP连接收到数据或FIN，UDP端口收到数据报，监听端口有待tcp_accept取出的连接
+#define EVENT_WRITABLE 0x02 // 可以写入：TCP连接建立，或者确认、窗口打开腾出了发送空间
+#define EVENT_CLOSED 0x04   // 协议栈关闭了连接或端口，此后不能再使用，总是会报告，不需要关注
+
+typedef struct event_reg //就绪事件的注册信息，嵌在连接、监听端口和udp端口中
+{
+    uint8_t interest; // 关注的事件，0表示没有注册
+    uint8_t queued;   // 已在就绪队列中，新的事件合并到队列中的那一项
+    uint32_t slot;    // 在就绪队列中的位置
+    void *data;       // 注册时的用户数据，随事件返回
+} event_reg_t;
+
+typedef struct net_event //返回给应用层的就绪事件
+{
+    uint8_t events; // EVENT_READABLE、EVENT_WRITABLE、EVENT_CLOSED的组合
+    void *data;     // 注册时的用户数据
+} net_event_t;
+
+void event_watch(event_reg_t *reg, uint8_t interest, void *data, uint8_t ready);
+void event_post(event_reg_t *reg, uint8_t events);
+void event_release(event_reg_t *reg);
+size_t event_get(net_event_t *events, size_t max);
+size_t event_poll(net_event_t *events, size_t max);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef ICMPV6_H
+#define ICMPV6_H
+
+#include "net.h"
+
+#pragma pack(1)
+typedef struct icmpv6_hdr
+{
+    uint8_t type;        // 类型
+    uint8_t code;        // 代码
+    uint16_t checksum16; // 含ipv6伪头部的校验和
+    uint32_t data32;     // 回显的标识符与序号，不可达的保留字段，或数据包过大的MTU
+} icmpv6_hdr_t;
+#pragma pack()
+
+typedef enum icmpv6_type
+{
+    ICMPV6_TYPE_UNREACH = 1,          // 目的不可达
+    ICMPV6_TYPE_PACKET_TOO_BIG = 2,   // 数据包过大
+    ICMPV6_TYPE_PARAM_PROBLEM = 4,    // 参数问题
+    ICMPV6_TYPE_ECHO_REQUEST = 128,   // 回显请求
+    ICMPV6_TYPE_ECHO_REPLY = 129,     // 回显响应
+    ICMPV6_TYPE_NEIGHBOR_SOLICIT = 135, // 邻居请求
+    ICMPV6_TYPE_NEIGHBOR_ADVERT = 136,  // 邻居通告
+} icmpv6_type_t;
+
+typedef enum icmpv6_code
+{
+    ICMPV6_CODE_PORT_UNREACH = 4,       // 端口不可达
+    ICMPV6_CODE_UNKNOWN_NEXT_HEADER = 1 // 参数问题：无法识别的下一个头部
+} icmpv6_code_t;
+
+void icmpv6_in(buf_t *buf, uint8_t *src_ip);
+void icmpv6_error(buf_t *recv_buf, uint8_t *src_ip, icmpv6_type_t type, icmpv6_code_t code, uint32_t data);
+void icmpv6_init();
+#endif
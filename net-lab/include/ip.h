@@ -24,7 +24,11 @@ typedef struct ip_hdr
 #define IP_HDR_OFFSET_PER_BYTE 8   //ip分片偏移长度单位
 #define IP_VERSION_4 4             //ipv4
 #define IP_MORE_FRAGMENT (1 << 13) //ip分片mf位
+#define IP_DONT_FRAGMENT (1 << 14) //ip分片df位
 void ip_in(buf_t *buf, uint8_t *src_mac);
 void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ip_out_df(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
 void ip_init();
+uint16_t ip_pmtu_get(uint8_t *ip);
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu);
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef IPV6_H
+#define IPV6_H
+
+#include "net.h"
+
+#pragma pack(1)
+typedef struct ipv6_hdr
+{
+    uint32_t ver_tc_flow32;         // 版本号(4位)、流量类别(8位)、流标签(20位)
+    uint16_t payload_len16;         // 负载长度，不含本头部
+    uint8_t next_header;            // 下一个头部/上层协议
+    uint8_t hop_limit;              // 跳数限制
+    uint8_t src_ip[NET_IP6_LEN];    // 源IP
+    uint8_t dst_ip[NET_IP6_LEN];    // 目标IP
+} ipv6_hdr_t;
+
+typedef struct ipv6_frag_hdr
+{
+    uint8_t next_header;            // 下一个头部/上层协议
+    uint8_t reserved;               // 置零
+    uint16_t offset_flags16;        // 分片偏移(13位)与mf位
+    uint32_t id32;                  // 标识符
+} ipv6_frag_hdr_t;
+
+typedef struct ipv6_peso_hdr
+{
+    uint8_t src_ip[NET_IP6_LEN];    // 源IP地址
+    uint8_t dst_ip[NET_IP6_LEN];    // 目的IP地址
+    uint32_t total_len32;           // 上层数据包的长度
+    uint8_t placeholder[3];         // 必须置0
+    uint8_t next_header;            // 上层协议号
+} ipv6_peso_hdr_t;
+#pragma pack()
+
+#define IP_VERSION_6 6                 //ipv6
+#define IPV6_NEXT_HEADER_FRAGMENT 44   //分片扩展头
+#define IPV6_MIN_MTU 1280              //ipv6链路最小MTU
+#define IPV6_MORE_FRAGMENT 1           //分片扩展头mf位
+
+static inline int ipv6_is_multicast(const uint8_t *ip) { return ip[0] == 0xff; }
+static inline int ipv6_is_link_local(const uint8_t *ip) { return ip[0] == 0xfe && (ip[1] & 0xc0) == 0x80; }
+
+void ipv6_in(buf_t *buf, uint8_t *src_mac);
+void ipv6_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol);
+void ipv6_init();
+uint8_t *ipv6_src_for(const uint8_t *dst_ip);
+uint16_t ipv6_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip, uint8_t next_header);
+uint16_t ipv6_pmtu_get(uint8_t *ip);
+void ipv6_pmtu_update(uint8_t *ip, uint32_t mtu);
+#endif
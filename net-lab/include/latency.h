@@ -0,0 +1,99 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "config.h"
+
+#ifdef LATENCY
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * @brief 测量的阶段，每个阶段一个直方图
+ *
+ */
+typedef enum latency_stage
+{
+    LATENCY_STAGE_ETHERNET,  // ethernet_in入口到网络层入口
+    LATENCY_STAGE_IP,        // 网络层入口到传输层入口
+    LATENCY_STAGE_TRANSPORT, // 传输层入口到调用处理程序
+    LATENCY_STAGE_HANDLER,   // 处理程序执行时间
+    LATENCY_STAGE_TOTAL,     // ethernet_in入口到处理完成
+    LATENCY_STAGE_TX_WAIT,   // tcp_connect_write写入到tcp_send发出
+    LATENCY_STAGE_NUM,
+} latency_stage_t;
+
+#define LATENCY_SUB_BUCKET_NUM (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKET_NUM ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKET_NUM) //覆盖全部64位取值
+
+/**
+ * @brief 对数-线性直方图，每个2的幂区间再等分为LATENCY_SUB_BUCKET_NUM个桶
+ *
+ */
+typedef struct latency_hist
+{
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKET_NUM];
+} latency_hist_t;
+
+extern _Thread_local uint64_t latency_start, latency_last;
+
+/**
+ * @brief 读取当前时间戳，x86上为TSC周期数，其余平台为纳秒
+ *
+ * @return uint64_t 时间戳
+ */
+static inline uint64_t latency_now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void latency_init();
+void latency_record(latency_stage_t stage, uint64_t ticks);
+uint64_t latency_percentile(latency_stage_t stage, double percentile);
+void latency_report(FILE *fp);
+void latency_reset();
+
+// 一个数据包开始处理
+#define LATENCY_BEGIN() (latency_start = latency_last = latency_now())
+// 到达下一层的边界，记录上一阶段的耗时
+#define LATENCY_MARK(stage)                              \
+    do                                                   \
+    {                                                    \
+        if (latency_last)                                \
+        {                                                \
+            uint64_t latency_mark_now = latency_now();   \
+            latency_record(stage, latency_mark_now - latency_last); \
+            latency_last = latency_mark_now;             \
+        }                                                \
+    } while (0)
+// 数据包处理完成，记录总耗时
+#define LATENCY_END()                                         \
+    do                                                        \
+    {                                                         \
+        if (latency_start)                                    \
+            latency_record(LATENCY_STAGE_TOTAL, latency_now() - latency_start); \
+        latency_start = latency_last = 0;                     \
+    } while (0)
+
+#else
+
+#define LATENCY_BEGIN() ((void)0)
+#define LATENCY_MARK(stage) ((void)0)
+#define LATENCY_END() ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "config.h"
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+#define LOG_ADDR_MAX_LEN 16 //一条记录最多携带的地址/数据字节数
+
+/**
+ * @brief 日志事件，格式串和地址类型见log.c中的事件表
+ *
+ */
+typedef enum log_event
+{
+    LOG_EVENT_ETH_SHORT_FRAME,
+    LOG_EVENT_ETH_SHORT_VLAN,
+    LOG_EVENT_ETH_OVER_MTU,
+    LOG_EVENT_ETH_UNKNOWN_VLAN,
+    LOG_EVENT_ETH_UNKNOWN_PROTOCOL,
+    LOG_EVENT_ETH_PADDING_FAILED,
+    LOG_EVENT_ETH_HEADER_FAILED,
+    LOG_EVENT_ETH_SEND_FAILED,
+    LOG_EVENT_TCP_SEND,
+    LOG_EVENT_TCP_RESET,
+    LOG_EVENT_UDP_RECV,
+    LOG_EVENT_TCP_RECV,
+    LOG_EVENT_APP_DATA,
+    LOG_EVENT_HTTP_CONNECTED,
+    LOG_EVENT_HTTP_CLOSED,
+    LOG_EVENT_HTTP_FINAL_CLOSE,
+    LOG_EVENT_NUM,
+} log_event_t;
+
+/**
+ * @brief 定长二进制日志记录，格式化推迟到log_drain
+ *
+ */
+typedef struct log_record
+{
+    int64_t sec;                    // 时间戳秒
+    int32_t nsec;                   // 时间戳纳秒
+    uint16_t event;                 // log_event_t
+    uint8_t level;                  // 日志级别
+    uint8_t addr_len;               // addr有效字节数
+    uint32_t args[3];               // 整数参数
+    uint8_t addr[LOG_ADDR_MAX_LEN]; // mac/ip/ipv6地址或数据片段
+} log_record_t;
+
+/**
+ * @brief 单生产者单消费者日志环，协议栈线程写入，log_drain读出
+ *
+ */
+typedef struct log_ring
+{
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t head; // 下一个写入位置，只由生产者修改
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t tail; // 下一个读出位置，只由消费者修改
+    _Alignas(CACHE_LINE_SIZE) _Atomic size_t dropped; // 环满时丢弃的记录数
+    log_record_t records[LOG_RING_LEN];
+} log_ring_t;
+
+extern log_ring_t log_ring;
+
+/**
+ * @brief 写入一条日志记录，环满时丢弃并计数，不阻塞收发路径
+ *
+ * @param level 日志级别
+ * @param event 日志事件
+ * @param addr 地址或数据，可为NULL
+ * @param addr_len addr的字节数，超过LOG_ADDR_MAX_LEN的部分截断
+ * @param a0 整数参数
+ * @param a1 整数参数
+ * @param a2 整数参数
+ */
+static inline void log_write(uint8_t level, log_event_t event, const void *addr, size_t addr_len,
+                             uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    size_t head = atomic_load_explicit(&log_ring.head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&log_ring.tail, memory_order_acquire) >= LOG_RING_LEN)
+    {
+        atomic_fetch_add_explicit(&log_ring.dropped, 1, memory_order_relaxed);
+        return;
+    }
+    log_record_t *record = &log_ring.records[head & (LOG_RING_LEN - 1)];
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    record->sec = ts.tv_sec;
+    record->nsec = ts.tv_nsec;
+    record->event = event;
+    record->level = level;
+    record->addr_len = addr ? (addr_len < LOG_ADDR_MAX_LEN ? addr_len : LOG_ADDR_MAX_LEN) : 0;
+    memcpy(record->addr, addr ? addr : "", record->addr_len);
+    record->args[0] = a0;
+    record->args[1] = a1;
+    record->args[2] = a2;
+    atomic_store_explicit(&log_ring.head, head + 1, memory_order_release);
+}
+
+// 低于编译期级别LOG_LEVEL的日志展开为空语句，参数不会被求值
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(event, addr, addr_len, a0, a1, a2) log_write(LOG_LEVEL_DEBUG, event, addr, addr_len, a0, a1, a2)
+#else
+#define LOG_DEBUG(event, addr, addr_len, a0, a1, a2) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(event, addr, addr_len, a0, a1, a2) log_write(LOG_LEVEL_INFO, event, addr, addr_len, a0, a1, a2)
+#else
+#define LOG_INFO(event, addr, addr_len, a0, a1, a2) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(event, addr, addr_len, a0, a1, a2) log_write(LOG_LEVEL_WARN, event, addr, addr_len, a0, a1, a2)
+#else
+#define LOG_WARN(event, addr, addr_len, a0, a1, a2) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(event, addr, addr_len, a0, a1, a2) log_write(LOG_LEVEL_ERROR, event, addr, addr_len, a0, a1, a2)
+#else
+#define LOG_ERROR(event, addr, addr_len, a0, a1, a2) ((void)0)
+#endif
+
+size_t log_drain(FILE *fp, size_t max);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef ND_H
+#define ND_H
+
+#include "net.h"
+
+#pragma pack(1)
+typedef struct nd_pkt
+{
+    uint8_t type;                    // 类型，邻居请求或邻居通告
+    uint8_t code;                    // 代码，置零
+    uint16_t checksum16;             // ICMPv6校验和
+    uint32_t flags32;                // 通告的R/S/O标志，请求中保留置零
+    uint8_t target_ip[NET_IP6_LEN];  // 目标地址
+    uint8_t opt_type;                // 链路层地址选项类型
+    uint8_t opt_len;                 // 选项长度，8字节为单位
+    uint8_t opt_mac[NET_MAC_LEN];    // 链路层地址
+} nd_pkt_t;
+
+typedef struct nd_key                // 邻居缓存的键，同一地址在不同vlan上可能是不同的主机
+{
+    uint8_t ip[NET_IP6_LEN];         // ipv6地址，放在最前面，打印时可以直接当作地址
+    uint16_t vid;                    // 所在vlan，0为不带标签
+} nd_key_t;
+#pragma pack()
+
+#define ND_OPT_SOURCE_MAC 1          // 源链路层地址选项
+#define ND_OPT_TARGET_MAC 2          // 目标链路层地址选项
+#define ND_FLAG_ROUTER (1u << 31)    // 通告者是路由器
+#define ND_FLAG_SOLICITED (1u << 30) // 是对请求的响应
+#define ND_FLAG_OVERRIDE (1u << 29)  // 覆盖已有缓存
+#define ND_HOP_LIMIT 255             // 邻居发现报文的跳数限制必须为255
+
+void nd_init();
+void nd_print();
+void nd_in(buf_t *buf, uint8_t *src_ip);
+void nd_out(buf_t *buf, uint8_t *ip);
+void nd_req(uint8_t *target_ip);
+void nd_resp(uint8_t *target_ip, uint8_t *target_mac);
+#endif
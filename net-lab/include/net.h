@@ -11,22 +11,47 @@ typedef enum net_protocol
 {
     NET_PROTOCOL_ARP = 0x0806,
     NET_PROTOCOL_IP = 0x0800,
+    NET_PROTOCOL_IPV6 = 0x86DD,
+    NET_PROTOCOL_VLAN = 0x8100,
     NET_PROTOCOL_ICMP = 1,
     NET_PROTOCOL_UDP = 17,
     NET_PROTOCOL_TCP = 6,
+    NET_PROTOCOL_ICMPV6 = 58,
 } net_protocol_t;
 
+#define NET_IPV6_UPPER(protocol) (0x0100 | (protocol)) //ipv6上层协议在协议表中的键，与ipv4上层协议区分注册
+#define NET_UPPER_PROTOCOL_NUM 256                     //ip上层协议号的个数
+#define NET_ETHERTYPE_NUM 3                            //支持的以太网协议个数：ip、arp、ipv6
+
 typedef void (*net_handler_t)(buf_t *buf, uint8_t *src);
 
+
 #define NET_MAC_LEN 6 //mac地址长度
 #define NET_IP_LEN 4  //ip地址长度
+#define NET_IP6_LEN 16 //ipv6地址长度
+
+typedef struct net_vlan //vlan子接口配置
+{
+    uint8_t valid;          //是否已配置
+    uint8_t ip[NET_IP_LEN]; //该vlan上的ip地址
+} net_vlan_t;
 
 extern uint8_t net_if_mac[NET_MAC_LEN];
 extern uint8_t net_if_ip[NET_IP_LEN];
+extern uint16_t net_if_mtu;
+extern uint32_t net_pmtu_gen;
+extern uint16_t net_if_vlan;
+extern uint8_t net_if_ip6[NET_IP6_LEN];
+extern uint8_t net_if_ip6_ll[NET_IP6_LEN];
 extern buf_t rxbuf, txbuf; //一个buf足够单线程使用
 
 int net_init();
 void net_poll();
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src);
 void net_add_protocol(uint16_t protocol, net_handler_t handler);
+int net_if_set_mtu(uint16_t mtu);
+int net_vlan_add(uint16_t vid, uint8_t *ip);
+void net_vlan_delete(uint16_t vid);
+int net_vlan_valid(uint16_t vid);
+int net_if_select(uint16_t vid);
 #endif
\ No newline at end of file
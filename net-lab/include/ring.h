@@ -0,0 +1,47 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+#include "config.h"
+
+typedef struct ring //字节环形缓冲区，容量为2的幂，读写位置自由增长，取模后定位，回绕时分两段拷贝，不需要搬移数据
+{
+    uint32_t head;  // 下一个写入位置
+    uint32_t tail;  // 下一个读出位置
+    uint32_t size;  // 容量，2的幂
+    uint8_t *data;  // 存储区
+} ring_t;
+
+int ring_init(ring_t *ring, uint32_t size);
+void ring_reset(ring_t *ring);
+void ring_free(ring_t *ring);
+uint32_t ring_write(ring_t *ring, const void *src, uint32_t len);
+void ring_write_at(ring_t *ring, uint32_t offset, const void *src, uint32_t len);
+void ring_commit(ring_t *ring, uint32_t len);
+void ring_peek(const ring_t *ring, uint32_t offset, void *dst, uint32_t len);
+void ring_consume(ring_t *ring, uint32_t len);
+uint32_t ring_read(ring_t *ring, void *dst, uint32_t len);
+
+/**
+ * @brief 环中已有数据的字节数
+ *
+ * @param ring 环
+ * @return uint32_t 字节数
+ */
+static inline uint32_t ring_len(const ring_t *ring)
+{
+    return ring->head - ring->tail;
+}
+
+/**
+ * @brief 环中空闲的字节数
+ *
+ * @param ring 环
+ * @return uint32_t 字节数
+ */
+static inline uint32_t ring_space(const ring_t *ring)
+{
+    return ring->size - ring_len(ring);
+}
+
+#endif
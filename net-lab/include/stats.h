@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include "config.h"
+
+/**
+ * @brief 协议栈计数器，名字见stats.c中的名字表
+ *
+ */
+typedef enum stats_counter
+{
+    STATS_ETH_RX,
+    STATS_ETH_TX,
+    STATS_ETH_DROP_SHORT,
+    STATS_ETH_DROP_MTU,
+    STATS_ETH_DROP_VLAN,
+    STATS_ETH_DROP_PROTOCOL,
+    STATS_ETH_TX_ERROR,
+
+    STATS_ARP_RX,
+    STATS_ARP_TX,
+    STATS_ARP_DROP_SHORT,
+    STATS_ARP_DROP_HEADER,
+
+    STATS_IP_RX,
+    STATS_IP_TX,
+    STATS_IP_DROP_SHORT,
+    STATS_IP_DROP_HEADER,
+    STATS_IP_DROP_CHECKSUM,
+    STATS_IP_DROP_DST,
+    STATS_IP_DROP_PROTOCOL,
+
+    STATS_ICMP_RX,
+    STATS_ICMP_TX,
+    STATS_ICMP_DROP_SHORT,
+
+    STATS_IPV6_RX,
+    STATS_IPV6_TX,
+    STATS_IPV6_DROP_HEADER,
+    STATS_IPV6_DROP_DST,
+    STATS_IPV6_DROP_FRAGMENT,
+    STATS_IPV6_DROP_PROTOCOL,
+
+    STATS_ICMPV6_RX,
+    STATS_ICMPV6_TX,
+    STATS_ICMPV6_DROP_SHORT,
+    STATS_ICMPV6_DROP_CHECKSUM,
+
+    STATS_UDP_RX,
+    STATS_UDP_TX,
+    STATS_UDP_DROP_SHORT,
+    STATS_UDP_DROP_CHECKSUM,
+    STATS_UDP_DROP_PORT,
+    STATS_UDP_DROP_QUEUE,
+
+    STATS_TCP_RX,
+    STATS_TCP_TX,
+    STATS_TCP_DROP_SHORT,
+    STATS_TCP_DROP_CHECKSUM,
+    STATS_TCP_DROP_PORT,
+    STATS_TCP_DROP_MULTICAST,
+    STATS_TCP_RESET,
+    STATS_TCP_RX_OOO,
+    STATS_TCP_DROP_OOO,
+    STATS_TCP_SYN_TIMEOUT,
+    STATS_TCP_SYN_COOKIE,
+    STATS_TCP_SYN_COOKIE_OK,
+    STATS_TCP_SYN_COOKIE_BAD,
+    STATS_TCP_ACCEPT_OVERFLOW,
+    STATS_TCP_TIME_WAIT,
+    STATS_TCP_TW_REUSE,
+    STATS_TCP_TW_OVERFLOW,
+    STATS_TCP_KEEPALIVE_PROBE,
+    STATS_TCP_KEEPALIVE_TIMEOUT,
+    STATS_TCP_FIN_WAIT2_TIMEOUT,
+
+    STATS_EVENT_OVERFLOW,
+
+    STATS_NUM,
+} stats_counter_t;
+
+/**
+ * @brief 一个核的计数器，按缓存行对齐，各核只写自己的一行
+ *
+ */
+typedef struct stats_core
+{
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t counters[STATS_NUM];
+} stats_core_t;
+
+extern stats_core_t stats_cores[STATS_CORE_NUM];
+extern _Thread_local uint8_t stats_core;
+
+/**
+ * @brief 计数器加一，只有本核写这一行，relaxed读写即可避免加锁指令
+ *
+ * @param counter 计数器
+ */
+static inline void stats_inc(stats_counter_t counter)
+{
+    _Atomic uint64_t *c = &stats_cores[stats_core].counters[counter];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void stats_set_core(uint8_t core);
+void stats_snapshot(uint64_t counters[STATS_NUM]);
+const char *stats_name(stats_counter_t counter);
+size_t stats_format(char *buf, size_t size);
+void stats_dump(FILE *fp);
+int stats_open(uint16_t port, const uint8_t *allow_ip);
+
+#endif
@@ -2,6 +2,10 @@
 #define TCP_H
 
 #include "net.h"
+#include "timer.h"
+#include "ring.h"
+#include "tcp_cc.h"
+#include "event.h"
 
 #pragma pack(1)
 
@@ -17,6 +21,8 @@ typedef struct tcp_flags {
 } tcp_flags_t;
 
 static const tcp_flags_t tcp_flags_null = {};
+static const tcp_flags_t tcp_flags_syn = { .syn = 1 };
+static const tcp_flags_t tcp_flags_rst = { .rst = 1 };
 static const tcp_flags_t tcp_flags_ack = { .ack = 1 };
 static const tcp_flags_t tcp_flags_ack_syn = { .ack = 1 ,.syn = 1 };
 static const tcp_flags_t tcp_flags_ack_fin = { .ack = 1, .fin = 1 };
@@ -45,11 +51,32 @@ typedef struct tcp_peso_hdr {
 
 #pragma pack()
 
+#define TCP_OPT_END 0     // 选项表结束
+#define TCP_OPT_NOP 1     // 填充
+#define TCP_OPT_MSS 2     // 最大报文段长度
+#define TCP_OPT_WSCALE 3  // 窗口扩大因子，RFC 7323
+#define TCP_OPT_SACK_PERM 4 // 允许SACK，RFC 2018
+#define TCP_OPT_SACK 5    // SACK区间
+#define TCP_OPT_TS 8      // 时间戳，RFC 7323
+#define TCP_OPT_MSS_LEN 4
+#define TCP_OPT_WSCALE_LEN 3
+#define TCP_OPT_SACK_PERM_LEN 2
+#define TCP_OPT_TS_LEN 10
+#define TCP_OPT_TS_ALIGNED_LEN 12 // 前面补两个NOP
+#define TCP_OPT_MAX_LEN 40
+#define TCP_SACK_BLOCK_MAX 4      // 一个报文段最多携带的SACK区间数
+#define TCP_WSCALE_MAX 14
+
+#define TCP_DEFAULT_MSS 536   // 对端没有通告MSS时ipv4的默认值
+#define TCP_DEFAULT_MSS6 1220 // 对端没有通告MSS时ipv6的默认值
+
+// 序号比较，考虑32位回绕
+#define TCP_SEQ_LT(a, b) ((int32_t)((a) - (b)) < 0)
+#define TCP_SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
 
 typedef enum tcp_state {
-    // 不使用状态 TCP_CLOSED,
     TCP_LISTEN = 0, /* 初始化的状态，没有分配缓存。处于这个状态时 tcp_connect_t 其他字段全是无效的
-                        其他状态rx_buf、tx_buf都在堆上动态分配了缓存，因此释放时要调用释放函数。
+                        其他状态rx_buf、tx_buf的存储区都在堆上动态分配，因此释放时要调用释放函数。
                     */
     TCP_SYN_SEND,
     TCP_SYN_RCVD,
@@ -60,25 +87,100 @@ typedef enum tcp_state {
     TCP_FIN_WAIT_2,
     TCP_CLOSING,
     TCP_TIME_WAIT,
+    TCP_CLOSED, // 协议栈已经关闭连接并释放了缓存，对象留给还持有句柄的应用层，等tcp_connect_close释放
 } tcp_state_t;
 
 typedef struct tcp_key {
-    uint8_t ip[NET_IP_LEN];
-    uint16_t src_port;
-    uint16_t dst_port;
+    uint8_t ip[NET_IP6_LEN];       // 对端地址，ipv4地址只用前NET_IP_LEN字节，其余置零
+    uint8_t local_ip[NET_IP6_LEN]; // 本端地址，同上
+    uint16_t src_port;             // 对端端口
+    uint16_t dst_port;             // 本端端口
+    uint8_t version;               // IP_VERSION_4或IP_VERSION_6
 } tcp_key_t;
 
+typedef struct tcp_range {
+    uint32_t start, end; // 序号区间[start, end)
+} tcp_range_t;
+
+/**
+ * @brief 从一个报文段中解析出的选项
+ *
+ */
+typedef struct tcp_opts {
+    uint16_t mss;       // 0表示没有
+    uint8_t wscale_ok;  // 带了窗口扩大因子
+    uint8_t wscale;
+    uint8_t sack_ok;    // 带了允许SACK
+    uint8_t ts_ok;      // 带了时间戳
+    uint32_t tsval, tsecr;
+    uint8_t sack_num;
+    tcp_range_t sack[TCP_SACK_BLOCK_MAX];
+} tcp_opts_t;
+
 typedef struct tcp_connect {
     tcp_state_t state;
+    tcp_key_t key;           // 在连接表中的完整四元组
+    uint32_t hash;           // key的哈希值，建立连接时算好
+    struct tcp_connect* port_next;   // 同一监听端口上的下一个连接
+    struct tcp_connect** port_pprev; // 指向链表中指向自己的指针，不在任何监听端口上时为NULL
     uint16_t local_port, remote_port;
-    uint8_t ip[NET_IP_LEN];
+    uint8_t ip[NET_IP6_LEN]; // 对端地址，ipv4地址只用前NET_IP_LEN字节
+    uint8_t version;         // IP_VERSION_4或IP_VERSION_6
+    uint16_t vlan;           // 连接所在的vlan，发送时切换到该vlan
     uint32_t unack_seq, next_seq; // tx_buf中前[next_seq - unack_seq]字节已经发送，unack_seq未确认的起始序号，next_seq下一发送序号
+    uint32_t max_seq;  // 已经发出的最大序号，低于它的报文段是重传
+    uint32_t snd_sml;  // 最近发出的不足MSS的报文段的结束序号，Nagle算法用
+    uint8_t nodelay;   // 关闭Nagle算法，不足MSS的数据立即发出
+    uint8_t cork;      // 攒够MSS才发送，直到取消cork
     uint32_t ack;
-    uint16_t remote_mss;
-    uint16_t remote_win;
+    uint32_t ack_sent; // 最近一次发出的确认号
+    uint32_t rcv_adv;  // 已通告的接收窗口右沿，窗口不能向左收回
+    uint16_t rcv_mss;  // 收到的最长报文段，作为对端发送MSS的估计，用于判断满长报文段
+    uint8_t ack_now;   // 已在本批收包的待确认表中，批末发出ACK
+    net_timer_t delack_timer; // 延迟确认定时器
+    uint32_t srtt, rttvar, rto; // 平滑往返时间、往返时间偏差与重传超时，毫秒
+    uint32_t rtt_seq;    // 正在计时的报文段的结束序号
+    uint64_t rtt_start;  // 该报文段的发送时间，0表示没有在计时
+    uint8_t retries;     // 连续重传次数
+    uint8_t fin_acked;   // 我方的FIN已被确认
+    net_timer_t rtx_timer; // 重传定时器
+    uint64_t rx_stamp;     // 最近收到报文段的时间，毫秒
+    uint32_t ka_idle;      // 保活：空闲多久后开始探测，毫秒，0表示关闭
+    uint32_t ka_intvl;     // 保活：探测间隔，毫秒
+    uint8_t ka_probes;     // 保活：连续多少次探测没有回应则中止连接
+    uint8_t ka_sent;       // 保活：已发出还没有回应的探测数
+    net_timer_t ka_timer;  // 保活定时器，应用层关闭后在FIN_WAIT_2中用作超时
+    tcp_range_t ooo[TCP_OOO_MAX]; // 已收到的乱序数据区间，按序号排列且互不相邻，数据在rx_buf中按序数据之后的对应位置
+    uint8_t ooo_num;
+    uint32_t cwnd, ssthresh; // 拥塞窗口与慢启动门限，字节
+    uint32_t recover;        // 进入快速恢复时已发出的最大序号，确认到这里才退出快速恢复
+    uint32_t dupacks;        // 连续重复ACK数
+    uint8_t in_recovery;     // 正在快速恢复
+    const tcp_cc_ops_t* cc;  // 拥塞控制算法
+    tcp_cubic_t cubic;
+    uint16_t remote_mss; // 对端通告的MSS
+    uint16_t path_mss;   // 按路径MTU算出的MSS上限，0表示还没有计算
+    uint32_t path_mss_gen; // 计算path_mss时的net_pmtu_gen，不相等时重新计算
+    uint32_t remote_win; // 对端的接收窗口，已按snd_wscale扩大
+    uint8_t snd_wscale, rcv_wscale; // 对端窗口的扩大因子与本端通告窗口的扩大因子，没有协商时为0
+    uint8_t sack_ok;     // 双方都允许SACK
+    uint8_t ts_ok;       // 双方都使用时间戳
+    uint32_t ts_recent;  // 最近收到的对端时间戳，用于回显和PAWS
+    uint32_t ooo_recent; // 最近收到的乱序数据的起始序号，SACK时把它所在的区间放在第一个
+    tcp_range_t sacked[TCP_SACKED_MAX]; // 对端SACK确认过的区间（发送方记分板），按序号排列
+    uint8_t sacked_num;
+    uint32_t rtx_next;   // 快速恢复中已经重传到的序号
+    uint8_t accepting;   // 在监听端口的全连接队列中等待tcp_accept取出
+    uint8_t owned;       // 应用层持有句柄（tcp_connect、tcp_accept返回的连接），协议栈关闭连接后不释放对象
+    uint8_t user_closed; // 应用层已经调用过tcp_connect_close
+    struct tcp_connect* reap_next; // 待释放链表中的下一个连接
     void* handler;
-    buf_t* rx_buf; // 接收缓存
-    buf_t* tx_buf; // 发送缓存
+    event_reg_t event;   // 就绪事件的注册信息
+    ring_t rx_buf; // 接收缓存，按序数据之后放乱序数据
+    ring_t tx_buf; // 发送缓存，开头是unack_seq处的数据，确认后移除
+#ifdef LATENCY
+    uint64_t tx_stamp; // tx_buf中最早未发送数据的写入时间戳，0表示没有未发送数据
+#endif
 } tcp_connect_t;
 
 static const tcp_connect_t CONNECT_LISTEN = {
@@ -96,12 +198,43 @@ typedef enum connect_state {
 
 typedef void (*tcp_handler_t)(tcp_connect_t* conect, connect_state_t state);
 
+/**
+ * @brief 监听端口
+ *
+ */
+typedef struct tcp_listener {
+    tcp_handler_t handler; // 该端口上连接的回调函数
+    uint32_t syn_num;      // 半连接数，不超过TCP_SYN_BACKLOG
+    uint32_t backlog;      // 全连接队列容量，0表示不使用队列，连接建立后以TCP_CONN_CONNECTED回调（tcp_open）
+    uint32_t accept_head;  // 全连接队列下一个写入位置，自由增长
+    uint32_t accept_tail;  // 全连接队列下一个读出位置，自由增长
+    uint64_t overflows;    // 全连接队列已满而丢弃的第三次握手数
+    uint64_t cookie_sent;  // 最近一次因半连接队列满而发出SYN cookie的时间，0表示从未发出
+    tcp_connect_t* accept_queue[TCP_ACCEPT_BACKLOG_MAX]; // 已建立、等待tcp_accept取出的连接
+    tcp_connect_t* connects; // 该端口上被动打开的连接，tcp_close时逐个关闭
+    struct tcp_syn* syns;    // 该端口上的半连接，tcp_close时逐个删除
+    event_reg_t event;     // 就绪事件的注册信息，全连接队列中有新连接时可读
+} tcp_listener_t;
+
 void tcp_init();
 int tcp_open(uint16_t port, tcp_handler_t handler);
+tcp_listener_t* tcp_listen(uint16_t port, uint32_t backlog, tcp_handler_t handler);
+size_t tcp_accept(tcp_listener_t* listener, tcp_connect_t** connects, size_t max);
+void tcp_listen_watch(tcp_listener_t* listener, uint8_t interest, void* data);
 void tcp_close(uint16_t port);
+tcp_connect_t* tcp_connect(uint8_t* ip, uint16_t port, tcp_handler_t handler);
+tcp_connect_t* tcp6_connect(uint8_t* ip, uint16_t port, tcp_handler_t handler);
 void tcp_connect_close(tcp_connect_t* connect);
 size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len);
 size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len);
+void tcp_connect_watch(tcp_connect_t* connect, uint8_t interest, void* data);
+int tcp_connect_set_cc(tcp_connect_t* connect, tcp_cc_t cc);
+void tcp_connect_set_nodelay(tcp_connect_t* connect, uint8_t nodelay);
+void tcp_connect_set_cork(tcp_connect_t* connect, uint8_t cork);
+void tcp_connect_set_keepalive(tcp_connect_t* connect, uint32_t idle_ms, uint32_t intvl_ms, uint8_t probes);
+uint16_t tcp_mss(tcp_connect_t* connect);
+void tcp_flush_acks();
 void tcp_in(buf_t* buf, uint8_t* src_ip);
+void tcp6_in(buf_t* buf, uint8_t* src_ip);
 
 #endif
@@ -0,0 +1,45 @@
+#ifndef TCP_CC_H
+#define TCP_CC_H
+
+#include <stdint.h>
+#include "config.h"
+
+struct tcp_connect;
+
+/**
+ * @brief 可选的拥塞控制算法
+ *
+ */
+typedef enum tcp_cc {
+    TCP_CC_NEWRENO,
+    TCP_CC_CUBIC,
+    TCP_CC_NUM,
+} tcp_cc_t;
+
+/**
+ * @brief CUBIC算法的连接状态
+ *
+ */
+typedef struct tcp_cubic {
+    uint32_t w_max;       // 上次减小窗口前的拥塞窗口，字节
+    uint32_t w_est;       // 按Reno方式估计的窗口，用于TCP友好区域，字节
+    uint64_t epoch_start; // 本轮拥塞避免开始的时间，毫秒，0表示还没有开始
+    double k;             // 从epoch_start起窗口增长回w_max所需的时间，秒
+} tcp_cubic_t;
+
+/**
+ * @brief 拥塞控制算法的回调，快速重传与快速恢复的流程由tcp.c完成，算法只负责调整cwnd与ssthresh
+ *
+ */
+typedef struct tcp_cc_ops {
+    const char* name;
+    void (*init)(struct tcp_connect* connect);                  // 连接建立时初始化算法状态
+    void (*ack)(struct tcp_connect* connect, uint32_t acked);   // 不在快速恢复中时确认了acked字节新数据
+    void (*dupack)(struct tcp_connect* connect);                // 快速恢复中又收到一个重复ACK
+    void (*loss)(struct tcp_connect* connect);                  // 重复ACK达到门限，进入快速恢复前
+    void (*rto)(struct tcp_connect* connect);                   // 重传超时
+} tcp_cc_ops_t;
+
+const tcp_cc_ops_t* tcp_cc_get(tcp_cc_t cc);
+
+#endif
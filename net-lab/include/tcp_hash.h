@@ -0,0 +1,35 @@
+#ifndef TCP_HASH_H
+#define TCP_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+/**
+ * @brief 哈希表的一个槽，保存对象的哈希值，探测时先比较哈希值，不必访问对象本身
+ *
+ */
+typedef struct tcp_hash_slot {
+    uint32_t hash;
+    void* obj; // NULL表示空槽
+} tcp_hash_slot_t;
+
+/**
+ * @brief 按完整四元组查找连接的开放定址哈希表，线性探测。对象在key_offset处嵌有键，
+ *        哈希值由调用者算好并保存在对象中，表只存指针；负载超过3/4时容量翻倍，删除时后移填补空槽，不留墓碑
+ *
+ */
+typedef struct tcp_hash {
+    tcp_hash_slot_t* slots;
+    uint32_t mask;     // 容量减一，容量是2的幂
+    uint32_t num;      // 对象数
+    size_t key_offset; // 键在对象中的偏移
+    size_t key_len;    // 键的长度，按字节比较
+} tcp_hash_t;
+
+int tcp_hash_init(tcp_hash_t* table, uint32_t size, size_t key_offset, size_t key_len);
+void* tcp_hash_get(const tcp_hash_t* table, const void* key, uint32_t hash);
+int tcp_hash_add(tcp_hash_t* table, void* obj, uint32_t hash);
+void tcp_hash_remove(tcp_hash_t* table, const void* obj, uint32_t hash);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include "config.h"
+
+typedef void (*net_timer_handler_t)(void *arg);
+
+/**
+ * @brief 协议栈定时器，嵌入在使用者的结构体中，由时间轮管理
+ *
+ */
+typedef struct net_timer
+{
+    struct net_timer *prev, *next; // 时间轮槽内的双向链表，未挂入时为NULL
+    uint64_t expire;               // 到期时间，毫秒
+    net_timer_handler_t handler;   // 到期时调用的处理程序
+    void *arg;                     // 处理程序的参数
+} net_timer_t;
+
+void timer_init();
+void timer_poll();
+uint64_t timer_now();
+void timer_setup(net_timer_t *timer, net_timer_handler_t handler, void *arg);
+void timer_add(net_timer_t *timer, uint64_t delay_ms);
+void timer_cancel(net_timer_t *timer);
+
+/**
+ * @brief 判断定时器是否在等待到期
+ *
+ * @param timer 定时器
+ * @return int 是为1，否为0
+ */
+static inline int timer_pending(const net_timer_t *timer)
+{
+    return timer->next != NULL;
+}
+
+#endif
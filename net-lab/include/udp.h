@@ -2,6 +2,8 @@
 #define UDP_H
 
 #include "net.h"
+#include "ring.h"
+#include "event.h"
 
 #pragma pack(1)
 typedef struct udp_hdr
@@ -24,10 +26,26 @@ typedef struct udp_peso_hdr
 
 typedef void (*udp_handler_t)(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port);
 
+typedef struct udp_port //打开的udp端口
+{
+    udp_handler_t handler; // 处理程序，NULL表示收到的数据报放入rx_buf，由udp_recv取出
+    ring_t rx_buf;         // 没有处理程序时的接收环，每个数据报前有一个udp_dgram_t
+    event_reg_t event;     // 就绪事件的注册信息
+} udp_port_t;
+
 void udp_init();
 void udp_in(buf_t *buf, uint8_t *src_ip);
 void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
 int udp_open(uint16_t port, udp_handler_t handler);
 void udp_close(uint16_t port);
+int udp_watch(uint16_t port, uint8_t interest, void *data);
+int udp_recv(uint16_t port, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port);
+void udp6_in(buf_t *buf, uint8_t *src_ip);
+void udp6_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+void udp6_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port);
+int udp6_open(uint16_t port, udp_handler_t handler);
+void udp6_close(uint16_t port);
+int udp6_watch(uint16_t port, uint8_t interest, void *data);
+int udp6_recv(uint16_t port, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port);
 #endif
\ No newline at end of file
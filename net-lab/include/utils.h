@@ -2,9 +2,12 @@
 #define UTILS_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <time.h>
 
 uint16_t checksum16(uint16_t *data, size_t len);
+uint32_t checksum_add(uint32_t sum, const void *data, size_t len);
+uint16_t checksum_fold(uint32_t sum);
 
 #define constswap16(x) ((((x)&0xFF) << 8) | (((x) >> 8) & 0xFF)) //为16位数据交换大小端
 //为16位数据交换大小端
@@ -25,9 +28,12 @@ static inline uint32_t min32(uint32_t a, uint32_t b) {
 }
 
 char *iptos(uint8_t *ip);
+char *ip6tos(uint8_t *ip);
 char *mactos(uint8_t *mac);
 char *timetos(time_t timestamp);
 uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb);
+int random_bytes(void *buf, size_t len);
+uint64_t siphash24(const uint8_t key[16], const void *data, size_t len);
 
 
 
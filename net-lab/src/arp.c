@@ -3,6 +3,8 @@
 #include "net.h"
 #include "arp.h"
 #include "ethernet.h"
+#include "stats.h"
+#include "latency.h"
 /**
  * @brief 初始的arp包
  * 
@@ -17,17 +19,31 @@ static const arp_pkt_t arp_init_pkt = {
     .target_mac = {0}};
 
 /**
- * @brief arp地址转换表，<ip,mac>的容器
+ * @brief arp地址转换表，<(ip,vlan),mac>的容器
  * 
  */
 map_t arp_table;
 
 /**
- * @brief arp buffer，<ip,buf_t>的容器
+ * @brief arp buffer，<(ip,vlan),buf_t>的容器
  * 
  */
 map_t arp_buf;
 
+/**
+ * @brief 当前收发所在vlan上ip对应的键
+ * 
+ * @param ip ip地址
+ * @return arp_key_t 键
+ */
+static arp_key_t arp_key(const uint8_t *ip)
+{
+    arp_key_t key;
+    memcpy(key.ip, ip, NET_IP_LEN);
+    key.vid = net_if_vlan;
+    return key;
+}
+
 /**
  * @brief 打印一条arp表项
  * 
@@ -72,6 +88,7 @@ void arp_req(uint8_t *target_ip)
 
     memcpy(txbuf.data, &arp_pkt01, sizeof(arp_pkt_t));
     uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    stats_inc(STATS_ARP_TX);
     ethernet_out(&txbuf, broadcast_mac, NET_PROTOCOL_ARP); //调用ethernet_out函数将ARP报文发送出去。注意：ARP announcement或ARP请求报文都是广播报文，其目标MAC地址应该是广播地址：FF-FF-FF-FF-FF-FF。
 }
 
@@ -98,6 +115,7 @@ void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
 
     memcpy(txbuf.data, &arp_pkt01, sizeof(arp_pkt_t));
 
+    stats_inc(STATS_ARP_TX);
     ethernet_out(&txbuf, target_mac, NET_PROTOCOL_ARP); //调用ethernet_out()函数将填充好的ARP报文发送出去。
 }
 
@@ -109,9 +127,12 @@ void arp_resp(uint8_t *target_ip, uint8_t *target_mac)
  */
 void arp_in(buf_t *buf, uint8_t *src_mac)
 {
+    LATENCY_MARK(LATENCY_STAGE_ETHERNET);
     if(buf->len < sizeof(arp_pkt_t)){ //首先判断数据长度，如果数据长度小于ARP头部长度，则认为数据包不完整，丢弃不处理。
+        stats_inc(STATS_ARP_DROP_SHORT);
         return;
     }else{
+        stats_inc(STATS_ARP_RX);
         arp_pkt_t *arp_pkt = (arp_pkt_t *)buf->data;
         //接着，做报头检查，查看报文是否完整，检测内容包括：ARP报头的硬件类型、上层协议类型、MAC硬件地址长度、IP协议地址长度、操作类型，检测该报头是否符合协议规定。
         if(arp_pkt->hw_type16 != swap16(ARP_HW_ETHER) ||
@@ -119,14 +140,16 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
         arp_pkt->hw_len != NET_MAC_LEN ||
         arp_pkt->pro_len != NET_IP_LEN ||
         (arp_pkt->opcode16 != swap16(ARP_REQUEST) && arp_pkt->opcode16 != swap16(ARP_REPLY))){
+            stats_inc(STATS_ARP_DROP_HEADER);
             return;
         }
-        map_set(&arp_table, arp_pkt->sender_ip, src_mac); //调用map_set()函数更新ARP表项。
+        arp_key_t key = arp_key(arp_pkt->sender_ip); //收包时net_if_vlan是这一帧所在的vlan。
+        map_set(&arp_table, &key, src_mac); //调用map_set()函数更新ARP表项。
 
-        buf_t *arp_buf01 = (buf_t *)map_get(&arp_buf, arp_pkt->sender_ip); //调用map_get()函数查看该接收报文的IP地址是否有对应的arp_buf缓存。
+        buf_t *arp_buf01 = (buf_t *)map_get(&arp_buf, &key); //调用map_get()函数查看该接收报文的IP地址是否有对应的arp_buf缓存。
         if(arp_buf01 != NULL){ //如果有，则说明ARP分组队列里面有待发送的数据包。也就是上一次调用arp_out()函数发送来自IP层的数据包时，由于没有找到对应的MAC地址进而先发送的ARP request报文，此时收到了该request的应答报文。
             ethernet_out(arp_buf01, arp_pkt->sender_mac, NET_PROTOCOL_IP); //然后，将缓存的数据包arp_buf再发送给以太网层，即调用ethernet_out()函数直接发出去
-            map_delete(&arp_buf, arp_pkt->sender_ip); //接着调用map_delete()函数将这个缓存的数据包删除掉。
+            map_delete(&arp_buf, &key); //接着调用map_delete()函数将这个缓存的数据包删除掉。
         }else if(arp_pkt->opcode16 == swap16(ARP_REQUEST) && memcmp(arp_pkt->target_ip, net_if_ip, NET_IP_LEN) == 0){ //接着调用map_delete()函数将这个缓存的数据包删除掉。
             arp_resp(arp_pkt->sender_ip, arp_pkt->sender_mac); //调用arp_resp()函数回应一个响应报文
         }
@@ -142,12 +165,13 @@ void arp_in(buf_t *buf, uint8_t *src_mac)
  */
 void arp_out(buf_t *buf, uint8_t *ip)
 {
-    uint8_t *target_mac = (uint8_t *)map_get(&arp_table, ip); //调用map_get()函数，根据IP地址来查找ARP表(arp_table)。
+    arp_key_t key = arp_key(ip); //在当前发包所在的vlan上解析。
+    uint8_t *target_mac = (uint8_t *)map_get(&arp_table, &key); //调用map_get()函数，根据IP地址来查找ARP表(arp_table)。
     if(target_mac != NULL){ //如果能找到该IP地址对应的MAC地址，则将数据包直接发送给以太网层，即调用ethernet_out函数直接发出去。
         ethernet_out(buf, target_mac, NET_PROTOCOL_IP);
         return;
-    }else if(map_get(&arp_buf, ip)==NULL){ //如果没有找到对应的MAC地址，进一步判断arp_buf是否已经有包了，如果有，则说明正在等待该ip回应ARP请求，此时不能再发送arp请求；如果没有包，则调用map_set()函数将来自IP层的数据包缓存到arp_buf，然后，调用arp_req()函数，发一个请求目标IP地址对应的MAC地址的ARP request报文。
-        map_set(&arp_buf, ip, buf);
+    }else if(map_get(&arp_buf, &key)==NULL){ //如果没有找到对应的MAC地址，进一步判断arp_buf是否已经有包了，如果有，则说明正在等待该ip回应ARP请求，此时不能再发送arp请求；如果没有包，则调用map_set()函数将来自IP层的数据包缓存到arp_buf，然后，调用arp_req()函数，发一个请求目标IP地址对应的MAC地址的ARP request报文。
+        map_set(&arp_buf, &key, buf);
         arp_req(ip);
     }
 }
@@ -158,8 +182,8 @@ void arp_out(buf_t *buf, uint8_t *ip)
  */
 void arp_init()
 {
-    map_init(&arp_table, NET_IP_LEN, NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL); //调用map_init()函数，初始化用于存储IP地址和MAC地址的ARP表arp_table，并设置超时时间为ARP_TIMEOUT_SEC。
-    map_init(&arp_buf, NET_IP_LEN, sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy); //调用map_init()函数，初始化用于缓存来自IP层的数据包，并设置超时时间为ARP_MIN_INTERVAL。
+    map_init(&arp_table, sizeof(arp_key_t), NET_MAC_LEN, 0, ARP_TIMEOUT_SEC, NULL); //调用map_init()函数，初始化用于存储IP地址和MAC地址的ARP表arp_table，并设置超时时间为ARP_TIMEOUT_SEC。
+    map_init(&arp_buf, sizeof(arp_key_t), sizeof(buf_t), 0, ARP_MIN_INTERVAL, buf_copy); //调用map_init()函数，初始化用于缓存来自IP层的数据包，并设置超时时间为ARP_MIN_INTERVAL。
     net_add_protocol(NET_PROTOCOL_ARP, arp_in); //调用net_add_protocol()函数，增加key：NET_PROTOCOL_ARP和vaule：arp_in的键值对。
     arp_req(net_if_ip); //在初始化阶段（系统启用网卡）时，要向网络上发送无回报ARP包（ARP announcemennt），即广播包，告诉所有人自己的IP地址和MAC地址。在实验代码中，调用arp_req()函数来发送一个无回报ARP包。
 }
@@ -1,5 +1,6 @@
 #include <pcap.h>
 #include "driver.h"
+#include "ethernet.h"
 
 #ifdef _WIN32
 #include <tchar.h>
@@ -30,6 +31,7 @@ BOOL LoadNpcapDlls()
 
 pcap_t *pcap;
 char pcap_errbuf[PCAP_ERRBUF_SIZE];
+static uint32_t driver_mask; //网卡掩码，编译过滤规则用
 
 /**
  * @brief 根据ip进行前缀匹配，选取最长前缀匹配的网卡
@@ -128,14 +130,44 @@ int driver_open()
         fprintf(stderr, "Error in pcap_setnonblock. %s.\n", pcap_errbuf);
         return -1;
     }
-    char filter_exp[PCAP_BUF_SIZE];
+    driver_mask = mask;
+    return driver_update_filter();
+}
+
+/**
+ * @brief 根据本机mac与已配置的vlan重新设置网卡过滤规则
+ *        标签帧只接收已配置的vlan，vlan过多时放行全部标签帧，由ethernet_in过滤
+ * 
+ * @return int 成功为0，失败为-1
+ */
+int driver_update_filter()
+{
+    if (pcap == NULL)
+        return 0;
+    char filter_exp[PCAP_BUF_SIZE * 4];
+    char vlan_exp[PCAP_BUF_SIZE * 2] = "ether[12:2] != 0x8100";
+    size_t vlan_len = strlen(vlan_exp);
+    for (uint16_t vid = 1; vid < NET_VLAN_MAX; vid++)
+    {
+        if (!net_vlan_valid(vid))
+            continue;
+        int n = snprintf(vlan_exp + vlan_len, sizeof(vlan_exp) - vlan_len, " or (ether[14:2] & 0x0fff) = %u", vid);
+        if (n < 0 || (size_t)n >= sizeof(vlan_exp) - vlan_len)
+        {
+            strcpy(vlan_exp, "1 = 1");
+            break;
+        }
+        vlan_len += n;
+    }
+
     struct bpf_program fp;
     uint8_t mac_addr[6] = NET_IF_MAC;
-    sprintf(filter_exp, //过滤数据包
-            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x)",
+    sprintf(filter_exp, //过滤数据包，33:33开头的是ipv6组播（邻居发现）
+            "(ether dst %02x:%02x:%02x:%02x:%02x:%02x or ether broadcast or ether[0:2] = 0x3333) and (not ether src %02x:%02x:%02x:%02x:%02x:%02x) and (%s)",
+            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
             mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5],
-            mac_addr[0], mac_addr[1], mac_addr[2], mac_addr[3], mac_addr[4], mac_addr[5]);
-    if (pcap_compile(pcap, &fp, filter_exp, 0, mask) < 0)
+            vlan_exp);
+    if (pcap_compile(pcap, &fp, filter_exp, 0, driver_mask) < 0)
     {
         fprintf(stderr, "Error in pcap_compile.\n%s.\n", pcap_geterr(pcap));
         return -1;
@@ -143,8 +175,10 @@ int driver_open()
     if (pcap_setfilter(pcap, &fp) < 0)
     {
         fprintf(stderr, "Error in pcap_setfilter.\n%s.\n", pcap_geterr(pcap));
+        pcap_freecode(&fp);
         return -1;
     }
+    pcap_freecode(&fp);
     return 0;
 }
 /**
@@ -157,15 +191,18 @@ int driver_recv(buf_t *buf)
 {
     struct pcap_pkthdr *pkt_hdr;
     const uint8_t *pkt_data;
-    int ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data);
-    if (ret == 0)
-        return 0;
-    else if (ret == 1)
+    int ret;
+    while ((ret = pcap_next_ex(pcap, &pkt_hdr, &pkt_data)) == 1)
     {
-        memcpy(buf->data, pkt_data, pkt_hdr->len);
-        buf->len = pkt_hdr->len;
-        return pkt_hdr->len;
+        //超过带802.1Q标签的巨型帧上限，丢弃后接着取下一个，不让调用者以为没有数据而结束本批收包
+        if (pkt_hdr->caplen > ETHERNET_MAX_JUMBO_UNIT + sizeof(ether_hdr_t) + sizeof(ether_vlan_tag_t))
+            continue;
+        buf_init(buf, pkt_hdr->caplen); //每次重新定位data，容纳最大到巨型帧的数据
+        memcpy(buf->data, pkt_data, pkt_hdr->caplen);
+        return pkt_hdr->caplen;
     }
+    if (ret == 0)
+        return 0;
     fprintf(stderr, "Error in driver_recv.\n%s.\n", pcap_geterr(pcap));
     return -1;
 }
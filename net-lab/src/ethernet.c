@@ -3,6 +3,9 @@
 #include "driver.h"
 #include "arp.h"
 #include "ip.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -10,21 +13,55 @@
  */
 void ethernet_in(buf_t *buf)
 {
+    LATENCY_BEGIN();
     if(buf->len < sizeof(ether_hdr_t)){ //首先判断数据长度，如果数据长度小于以太网头部长度，则认为数据包不完整，丢弃不处理。
-        printf("Oooooooops! The data length is less than the Ethernet header length. Error!\n");
+        LOG_WARN(LOG_EVENT_ETH_SHORT_FRAME, NULL, 0, buf->len, 0, 0);
+        stats_inc(STATS_ETH_DROP_SHORT);
         return;
     }
+    stats_inc(STATS_ETH_RX);
     ether_hdr_t *eth_hdr = (ether_hdr_t *)buf->data;
     if(buf_remove_header(buf, sizeof(ether_hdr_t)) < 0){ //调用buf_remove_header()函数移除加以太网包头。
-        printf("Oooooooops! buf_remove_header error!\n");
+        LOG_WARN(LOG_EVENT_ETH_SHORT_FRAME, NULL, 0, buf->len, 0, 0);
+        stats_inc(STATS_ETH_DROP_SHORT);
         return;
     }
     
     uint16_t protoc = swap16(eth_hdr->protocol16);
-    if(net_in(buf, protoc, eth_hdr->src) < 0){ //调用net_in()函数向上层传递数据包。
-        printf("Oooooooops! net_in error!\n");
+    uint16_t vid = 0;
+    if(protoc == NET_PROTOCOL_VLAN){ //802.1Q标签帧，取出vlan id和内层协议，去掉标签。
+        ether_vlan_tag_t *tag = (ether_vlan_tag_t *)buf->data;
+        if(buf_remove_header(buf, sizeof(ether_vlan_tag_t)) < 0){
+            LOG_WARN(LOG_EVENT_ETH_SHORT_VLAN, eth_hdr->src, NET_MAC_LEN, 0, 0, 0);
+            stats_inc(STATS_ETH_DROP_SHORT);
+            return;
+        }
+        vid = swap16(tag->tci16) & ETHERNET_VLAN_ID_MASK;
+        protoc = swap16(tag->protocol16);
+    }
+    if(protoc < ETHERNET_TYPE_MIN){ //802.3帧的长度字段不是协议号，丢弃，否则会与ip上层协议号混在一起分发。
+        LOG_DEBUG(LOG_EVENT_ETH_UNKNOWN_PROTOCOL, eth_hdr->src, NET_MAC_LEN, protoc, 0, 0);
+        stats_inc(STATS_ETH_DROP_PROTOCOL);
+        return;
+    }
+    if(buf->len > net_if_mtu){ //超过网卡MTU的帧（如未开启巨型帧时收到的巨型帧）丢弃不处理。
+        LOG_WARN(LOG_EVENT_ETH_OVER_MTU, eth_hdr->src, NET_MAC_LEN, buf->len, net_if_mtu, 0);
+        stats_inc(STATS_ETH_DROP_MTU);
+        return;
+    }
+    if(net_if_select(vid) < 0){ //切换到该vlan子接口，未配置的vlan丢弃不处理。
+        LOG_DEBUG(LOG_EVENT_ETH_UNKNOWN_VLAN, eth_hdr->src, NET_MAC_LEN, vid, 0, 0);
+        stats_inc(STATS_ETH_DROP_VLAN);
+        return;
+    }
+    int ret = net_in(buf, protoc, eth_hdr->src); //调用net_in()函数向上层传递数据包，处理中的回复沿用这一帧的vlan。
+    net_if_select(0); //处理完回到不带标签的接口，应用层和定时器发包时不会沿用最后收到的帧的vlan。
+    if(ret < 0){
+        LOG_DEBUG(LOG_EVENT_ETH_UNKNOWN_PROTOCOL, eth_hdr->src, NET_MAC_LEN, protoc, 0, 0);
+        stats_inc(STATS_ETH_DROP_PROTOCOL);
         return;
     }
+    LATENCY_END();
 }
 /**
  * @brief 处理一个要发送的数据包
@@ -37,12 +74,25 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
 {
     if(buf->len < ETHERNET_MIN_TRANSPORT_UNIT){ //首先判断数据长度，如果不足46则显式填充0，填充可以调用buf_add_padding()函数来实现。
         if(buf_add_padding(buf, ETHERNET_MIN_TRANSPORT_UNIT - buf->len) < 0){
-            printf("Oooooooops! buf_add_padding error!\n");
+            LOG_ERROR(LOG_EVENT_ETH_PADDING_FAILED, mac, NET_MAC_LEN, buf->len, 0, 0);
+            stats_inc(STATS_ETH_TX_ERROR);
+            return;
+        }
+    }
+    if(net_if_vlan){ //当前在vlan子接口上，先插入802.1Q标签。
+        if(buf_add_header(buf, sizeof(ether_vlan_tag_t)) < 0){
+            LOG_ERROR(LOG_EVENT_ETH_HEADER_FAILED, mac, NET_MAC_LEN, buf->len, 0, 0);
+            stats_inc(STATS_ETH_TX_ERROR);
             return;
         }
+        ether_vlan_tag_t *tag = (ether_vlan_tag_t *)buf->data;
+        tag->tci16 = swap16(net_if_vlan);
+        tag->protocol16 = swap16(protocol);
+        protocol = NET_PROTOCOL_VLAN;
     }
     if(buf_add_header(buf, sizeof(ether_hdr_t)) < 0){ //调用buf_add_header()函数添加以太网包头。
-        printf("Oooooooops! buf_add_header error!\n");
+        LOG_ERROR(LOG_EVENT_ETH_HEADER_FAILED, mac, NET_MAC_LEN, buf->len, 0, 0);
+        stats_inc(STATS_ETH_TX_ERROR);
         return;
     }
     ether_hdr_t *hdr = (ether_hdr_t *)buf->data;
@@ -51,9 +101,11 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
     hdr->protocol16 = swap16(protocol); //填写协议类型 protocol。
 
     if(driver_send(buf) < 0){ //调用驱动层封装好的driver_send()发送函数，将添加了以太网包头的数据帧发送到驱动层。
-        printf("Oooooooops! driver_send error!\n");
+        LOG_ERROR(LOG_EVENT_ETH_SEND_FAILED, mac, NET_MAC_LEN, buf->len, 0, 0);
+        stats_inc(STATS_ETH_TX_ERROR);
         return;
     }
+    stats_inc(STATS_ETH_TX);
 }
 /**
  * @brief 初始化以太网协议
@@ -61,15 +113,15 @@ void ethernet_out(buf_t *buf, const uint8_t *mac, net_protocol_t protocol)
  */
 void ethernet_init()
 {
-    buf_init(&rxbuf, ETHERNET_MAX_TRANSPORT_UNIT + sizeof(ether_hdr_t));
+    buf_init(&rxbuf, net_if_mtu + sizeof(ether_hdr_t));
 }
 
 /**
- * @brief 一次以太网轮询
+ * @brief 一次以太网轮询，最多处理NET_RX_BATCH个包
  * 
  */
 void ethernet_poll()
 {
-    if (driver_recv(&rxbuf) > 0)
+    for (int i = 0; i < NET_RX_BATCH && driver_recv(&rxbuf) > 0; i++)
         ethernet_in(&rxbuf);
 }
@@ -0,0 +1,127 @@
+#include "event.h"
+#include "net.h"
+#include "stats.h"
+
+/**
+ * @brief 就绪队列中的一项，事件按值保存，注册信息所在的对象被释放后仍能取出
+ *
+ */
+typedef struct event_entry
+{
+    net_event_t event;
+    event_reg_t *reg; // 所属的注册信息，已被释放或取消注册时为NULL
+} event_entry_t;
+
+/**
+ * @brief 就绪队列，读写位置自由增长，取模后定位
+ *
+ */
+static event_entry_t event_queue[EVENT_QUEUE_LEN];
+static uint32_t event_head; // 下一个写入位置
+static uint32_t event_tail; // 下一个读出位置
+
+/**
+ * @brief 注册、修改或取消对一个对象的就绪事件的关注
+ *        修改时尚未取出的事件按新的关注过滤，取消注册时丢弃
+ *
+ * @param reg 对象中的注册信息
+ * @param interest 关注的事件，0表示取消注册
+ * @param data 用户数据，随事件返回
+ * @param ready 对象当前已经满足的事件，注册时立即报告一次，避免错过注册之前的边沿
+ */
+void event_watch(event_reg_t *reg, uint8_t interest, void *data, uint8_t ready)
+{
+    if (reg->queued)
+    {
+        event_entry_t *entry = &event_queue[reg->slot % EVENT_QUEUE_LEN];
+        entry->event.events &= interest | EVENT_CLOSED;
+        entry->event.data = data;
+        if (!interest)
+        {
+            entry->event.events = 0;
+            entry->reg = NULL;
+            reg->queued = 0;
+        }
+    }
+    reg->interest = interest;
+    reg->data = data;
+    event_post(reg, ready);
+}
+
+/**
+ * @brief 对象上出现了新的边沿，放入就绪队列；已在队列中时合并到同一项
+ *
+ * @param reg 对象中的注册信息
+ * @param events 出现的事件
+ */
+void event_post(event_reg_t *reg, uint8_t events)
+{
+    events &= reg->interest | EVENT_CLOSED;
+    if (!reg->interest || !events)
+        return;
+    if (reg->queued)
+    {
+        event_queue[reg->slot % EVENT_QUEUE_LEN].event.events |= events;
+        return;
+    }
+    if (event_head - event_tail == EVENT_QUEUE_LEN)
+    {
+        stats_inc(STATS_EVENT_OVERFLOW);
+        return;
+    }
+    event_entry_t *entry = &event_queue[event_head % EVENT_QUEUE_LEN];
+    entry->event.events = events;
+    entry->event.data = reg->data;
+    entry->reg = reg;
+    reg->slot = event_head++;
+    reg->queued = 1;
+}
+
+/**
+ * @brief 对象即将被协议栈释放，已在队列中的事件保留，但不再引用注册信息
+ *
+ * @param reg 对象中的注册信息
+ */
+void event_release(event_reg_t *reg)
+{
+    if (reg->queued)
+        event_queue[reg->slot % EVENT_QUEUE_LEN].reg = NULL;
+    reg->queued = 0;
+    reg->interest = 0;
+}
+
+/**
+ * @brief 从就绪队列中取出最多max个事件，边沿触发：取出后只有出现新的边沿才会再次报告，
+ *        所以应用层要一直读到没有数据、写到写不进去为止
+ *
+ * @param events 取出的事件
+ * @param max 最多取出的个数
+ * @return size_t 取出的个数
+ */
+size_t event_get(net_event_t *events, size_t max)
+{
+    size_t n = 0;
+    while (n < max && event_tail != event_head)
+    {
+        event_entry_t *entry = &event_queue[event_tail++ % EVENT_QUEUE_LEN];
+        if (entry->reg)
+            entry->reg->queued = 0;
+        if (entry->event.events)
+            events[n++] = entry->event;
+    }
+    return n;
+}
+
+/**
+ * @brief 轮询一次协议栈，再取出这次轮询中就绪的事件
+ *        协议栈处理收包时只记录事件，应用层的工作在轮询之外完成，不会重入协议栈
+ *
+ * @param events 取出的事件
+ * @param max 最多取出的个数
+ * @return size_t 取出的个数
+ */
+size_t event_poll(net_event_t *events, size_t max)
+{
+    net_poll();
+    return event_get(events, max);
+}
@@ -2,47 +2,12 @@
 #include "tcp.h"
 #include "net.h"
 #include "assert.h"
+#include "ipv6.h"
+#include "log.h"
 
-#define TCP_FIFO_SIZE 40
+#define HTTP_BACKLOG 40     // 等待处理的连接数上限
 
-typedef struct http_fifo {
-    tcp_connect_t* buffer[TCP_FIFO_SIZE];
-    uint8_t front, tail, count;
-} http_fifo_t;
-
-static http_fifo_t http_fifo_v;
-
-static void http_fifo_init(http_fifo_t* fifo) {
-    fifo->count = 0;
-    fifo->front = 0;
-    fifo->tail = 0;
-}
-
-static int http_fifo_in(http_fifo_t* fifo, tcp_connect_t* tcp) {
-    if (fifo->count >= TCP_FIFO_SIZE) {
-        return -1;
-    }
-    fifo->buffer[fifo->front] = tcp;
-    fifo->front++;
-    if (fifo->front >= TCP_FIFO_SIZE) {
-        fifo->front = 0;
-    }
-    fifo->count++;
-    return 0;
-}
-
-static tcp_connect_t* http_fifo_out(http_fifo_t* fifo) {
-    if (fifo->count == 0) {
-        return NULL;
-    }
-    tcp_connect_t* tcp = fifo->buffer[fifo->tail];
-    fifo->tail++;
-    if (fifo->tail >= TCP_FIFO_SIZE) {
-        fifo->tail = 0;
-    }
-    fifo->count--;
-    return tcp;
-}
+static tcp_listener_t* http_listener;
 
 static size_t get_line(tcp_connect_t* tcp, char* buf, size_t size) {
     size_t i = 0;
@@ -56,6 +21,8 @@ static size_t get_line(tcp_connect_t* tcp, char* buf, size_t size) {
                 buf[i] = c;
                 i++;
             }
+        } else if (tcp->state == TCP_CLOSED) {
+            break;  // 对端已断开，连接对象仍由本模块持有，交给close_http释放
         }
         net_poll();
     }
@@ -66,6 +33,9 @@ static size_t get_line(tcp_connect_t* tcp, char* buf, size_t size) {
 static size_t http_send(tcp_connect_t* tcp, const char* buf, size_t size) {
     size_t send = 0;
     while (send < size) {
+        if (tcp->state == TCP_CLOSED) {
+            break;
+        }
         send += tcp_connect_write(tcp, (const uint8_t*)buf + send, size - send);
         net_poll();
     }
@@ -73,8 +43,8 @@ static size_t http_send(tcp_connect_t* tcp, const char* buf, size_t size) {
 }
 
 static void close_http(tcp_connect_t* tcp) {
+    LOG_INFO(LOG_EVENT_HTTP_CLOSED, tcp->ip, tcp->version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN, tcp->remote_port, 0, 0);
     tcp_connect_close(tcp);
-    printf("http closed.\n");
 }
 
 
@@ -100,11 +70,10 @@ static void send_file(tcp_connect_t* tcp, const char* url) {
 
 static void http_handler(tcp_connect_t* tcp, connect_state_t state) {
     if (state == TCP_CONN_CONNECTED) {
-        http_fifo_in(&http_fifo_v, tcp);
-        printf("http conntected.\n");
+        // 监听端口带全连接队列，新连接由http_server_run通过tcp_accept取出
     } else if (state == TCP_CONN_DATA_RECV) {
     } else if (state == TCP_CONN_CLOSED) {
-        printf("http closed.\n");
+        LOG_INFO(LOG_EVENT_HTTP_CLOSED, tcp->ip, tcp->version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN, tcp->remote_port, 0, 0);
     } else {
         assert(0);
     }
@@ -114,22 +83,24 @@ static void http_handler(tcp_connect_t* tcp, connect_state_t state) {
 // 在端口上创建服务器。
 
 int http_server_open(uint16_t port) {
-    if (!tcp_open(port, http_handler)) {
+    http_listener = tcp_listen(port, HTTP_BACKLOG, http_handler);
+    if (http_listener == NULL) {
         return -1;
     }
-    http_fifo_init(&http_fifo_v);
     return 0;
 }
 
-// 从FIFO取出请求并处理。新的HTTP请求时会发送到FIFO中等待处理。
+// 从全连接队列逐个取出请求并处理。新的HTTP连接建立后会放入队列中等待处理。
+// 处理一个请求时会反复调用net_poll，其余连接留在队列里由协议栈管理，不在这里持有裸指针。
 
 void http_server_run(void) {
     tcp_connect_t* tcp;
     char url_path[255];
     char rx_buffer[1024];
 
-    while ((tcp = http_fifo_out(&http_fifo_v)) != NULL) {
+    while (tcp_accept(http_listener, &tcp, 1) > 0) {
         int i;
+        LOG_INFO(LOG_EVENT_HTTP_CONNECTED, tcp->ip, tcp->version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN, tcp->remote_port, 0, 0);
         char* c = rx_buffer;
 
 
@@ -161,6 +132,6 @@ void http_server_run(void) {
        // TODO
 
 
-        printf("!! final close\n");
+        LOG_DEBUG(LOG_EVENT_HTTP_FINAL_CLOSE, NULL, 0, 0, 0, 0);
     }
 }
@@ -1,6 +1,8 @@
 #include "net.h"
 #include "icmp.h"
 #include "ip.h"
+#include "stats.h"
+#include "latency.h"
 
 /**
  * @brief 发送icmp响应
@@ -31,9 +33,48 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
     icmp_header->checksum16 = checksum16((uint16_t *)icmp_header, txbuf.len);
 
     // 发送数据报
+    stats_inc(STATS_ICMP_TX);
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
+/**
+ * @brief RFC 1191中的MTU平台值，旧路由器不填下一跳MTU时用来估计
+ * 
+ */
+static const uint16_t icmp_mtu_plateaus[] = {32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68};
+
+/**
+ * @brief 处理需要分片的不可达报文，更新路径MTU缓存
+ * 
+ * @param buf 收到的icmp报文
+ */
+static void icmp_frag_needed(buf_t *buf)
+{
+    if (buf->len < sizeof(icmp_hdr_t) + sizeof(ip_hdr_t) + 8) {
+        // 没有携带完整的原始ip头部
+        return;
+    }
+    icmp_hdr_t *icmphdr = (icmp_hdr_t *)buf->data;
+    ip_hdr_t *orig_hdr = (ip_hdr_t *)(icmphdr + 1);
+    if (memcmp(orig_hdr->src_ip, net_if_ip, NET_IP_LEN) != 0) {
+        // 原始数据包不是本机发出的
+        return;
+    }
+
+    uint16_t mtu = swap16(icmphdr->seq16);
+    if (mtu == 0) {
+        // 旧路由器不填下一跳MTU，取比原始包长小的平台值
+        uint16_t orig_len = swap16(orig_hdr->total_len16);
+        for (size_t i = 0; i < sizeof(icmp_mtu_plateaus) / sizeof(icmp_mtu_plateaus[0]); i++) {
+            if (icmp_mtu_plateaus[i] < orig_len) {
+                mtu = icmp_mtu_plateaus[i];
+                break;
+            }
+        }
+    }
+    ip_pmtu_update(orig_hdr->dst_ip, mtu);
+}
+
 /**
  * @brief 处理一个收到的数据包
  * 
@@ -42,16 +83,22 @@ static void icmp_resp(buf_t *req_buf, uint8_t *src_ip)
  */
 void icmp_in(buf_t *buf, uint8_t *src_ip)
 {
+    LATENCY_MARK(LATENCY_STAGE_IP);
     if (buf->len < sizeof(icmp_hdr_t)) {
         // 接收到的包长小于ICMP头部长度
+        stats_inc(STATS_ICMP_DROP_SHORT);
         return;
     }
+    stats_inc(STATS_ICMP_RX);
 
     icmp_hdr_t *icmphdr = (icmp_hdr_t *)buf->data;
 
     if (icmphdr->type == ICMP_TYPE_ECHO_REQUEST) {
         // 是回显请求
         icmp_resp(buf, src_ip);
+    } else if (icmphdr->type == ICMP_TYPE_UNREACH && icmphdr->code == ICMP_CODE_FRAG_NEEDED) {
+        // 路径上有更小的MTU
+        icmp_frag_needed(buf);
     }
 }
 
@@ -79,6 +126,7 @@ void icmp_unreachable(buf_t *recv_buf, uint8_t *src_ip, icmp_code_t code)
     icmp_hdr->checksum16 = checksum16((uint16_t *) icmp_hdr, txbuf.len);
 
     // 发送数据报
+    stats_inc(STATS_ICMP_TX);
     ip_out(&txbuf, src_ip, NET_PROTOCOL_ICMP);
 }
 
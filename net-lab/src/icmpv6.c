@@ -0,0 +1,118 @@
+#include "net.h"
+#include "icmpv6.h"
+#include "ipv6.h"
+#include "nd.h"
+#include "stats.h"
+#include "latency.h"
+
+/**
+ * @brief 发送icmpv6回显响应
+ *
+ * @param req_buf 收到的icmpv6请求包
+ * @param src_ip 源ip地址
+ */
+static void icmpv6_resp(buf_t *req_buf, uint8_t *src_ip)
+{
+    buf_t txbuf;
+    buf_init(&txbuf, req_buf->len);
+    memcpy(txbuf.data, req_buf->data, req_buf->len);
+
+    icmpv6_hdr_t *hdr = (icmpv6_hdr_t *)txbuf.data;
+    hdr->type = ICMPV6_TYPE_ECHO_REPLY;
+    hdr->code = 0;
+    hdr->checksum16 = 0;
+    hdr->checksum16 = ipv6_checksum(&txbuf, ipv6_src_for(src_ip), src_ip, NET_PROTOCOL_ICMPV6);
+
+    stats_inc(STATS_ICMPV6_TX);
+    ipv6_out(&txbuf, src_ip, NET_PROTOCOL_ICMPV6);
+}
+
+/**
+ * @brief 处理一个收到的数据包
+ *
+ * @param buf 要处理的数据包
+ * @param src_ip 源ip地址
+ */
+void icmpv6_in(buf_t *buf, uint8_t *src_ip)
+{
+    LATENCY_MARK(LATENCY_STAGE_IP);
+    if (buf->len < sizeof(icmpv6_hdr_t))
+    {
+        stats_inc(STATS_ICMPV6_DROP_SHORT);
+        return;
+    }
+    stats_inc(STATS_ICMPV6_RX);
+
+    // 校验和覆盖ipv6伪头部，目的地址取自buf->data之前仍保留的ipv6头部
+    ipv6_hdr_t *ip_hdr = (ipv6_hdr_t *)(buf->data - sizeof(ipv6_hdr_t));
+    icmpv6_hdr_t *hdr = (icmpv6_hdr_t *)buf->data;
+    uint16_t checksum = hdr->checksum16;
+    hdr->checksum16 = 0;
+    if (checksum != ipv6_checksum(buf, src_ip, ip_hdr->dst_ip, NET_PROTOCOL_ICMPV6))
+    {
+        stats_inc(STATS_ICMPV6_DROP_CHECKSUM);
+        return;
+    }
+    hdr->checksum16 = checksum;
+
+    switch (hdr->type)
+    {
+    case ICMPV6_TYPE_ECHO_REQUEST:
+        icmpv6_resp(buf, src_ip);
+        break;
+    case ICMPV6_TYPE_NEIGHBOR_SOLICIT:
+    case ICMPV6_TYPE_NEIGHBOR_ADVERT:
+        nd_in(buf, src_ip);
+        break;
+    case ICMPV6_TYPE_PACKET_TOO_BIG:
+        // 携带的原始数据包由本机发出时，更新到原始目的地址的路径MTU
+        if (buf->len >= sizeof(icmpv6_hdr_t) + sizeof(ipv6_hdr_t))
+        {
+            ipv6_hdr_t *orig_hdr = (ipv6_hdr_t *)(hdr + 1);
+            if (!memcmp(orig_hdr->src_ip, ipv6_src_for(orig_hdr->dst_ip), NET_IP6_LEN))
+                ipv6_pmtu_update(orig_hdr->dst_ip, swap32(hdr->data32));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief 发送icmpv6差错报文
+ *
+ * @param recv_buf 收到的ipv6数据包
+ * @param src_ip 源ip地址
+ * @param type 差错类型
+ * @param code 差错代码
+ * @param data 头部第二个字，如参数问题的指针
+ */
+void icmpv6_error(buf_t *recv_buf, uint8_t *src_ip, icmpv6_type_t type, icmpv6_code_t code, uint32_t data)
+{
+    // 差错报文不能超过ipv6最小MTU，尽量多地携带原始数据包
+    size_t len = min32(recv_buf->len, IPV6_MIN_MTU - sizeof(ipv6_hdr_t) - sizeof(icmpv6_hdr_t));
+    uint8_t dst_ip[NET_IP6_LEN];
+    memcpy(dst_ip, src_ip, NET_IP6_LEN);
+
+    buf_init(&txbuf, len);
+    memcpy(txbuf.data, recv_buf->data, len);
+    buf_add_header(&txbuf, sizeof(icmpv6_hdr_t));
+    icmpv6_hdr_t *hdr = (icmpv6_hdr_t *)txbuf.data;
+    hdr->type = type;
+    hdr->code = code;
+    hdr->checksum16 = 0;
+    hdr->data32 = swap32(data);
+    hdr->checksum16 = ipv6_checksum(&txbuf, ipv6_src_for(dst_ip), dst_ip, NET_PROTOCOL_ICMPV6);
+
+    stats_inc(STATS_ICMPV6_TX);
+    ipv6_out(&txbuf, dst_ip, NET_PROTOCOL_ICMPV6);
+}
+
+/**
+ * @brief 初始化icmpv6协议
+ *
+ */
+void icmpv6_init()
+{
+    net_add_protocol(NET_IPV6_UPPER(NET_PROTOCOL_ICMPV6), icmpv6_in);
+}
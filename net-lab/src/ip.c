@@ -1,11 +1,107 @@
+#include <stdatomic.h>
 #include "net.h"
 #include "ip.h"
 #include "ethernet.h"
 #include "arp.h"
 #include "icmp.h"
+#include "stats.h"
+#include "latency.h"
 
-extern FILE *arp_fout;
-void fprint_buf(FILE* f, buf_t* buf);
+/**
+ * @brief 路径MTU缓存的表项
+ * 
+ */
+typedef struct ip_pmtu
+{
+    uint8_t ip[NET_IP_LEN]; // 目标ip地址
+    uint16_t mtu;           // 路径MTU，不低于IP_PMTU_MIN
+    uint8_t no_df;          // 报告的MTU低于IP_PMTU_MIN，只记下下限，发往该目标的包不再设置df位，由路由器分片
+    time_t expire;          // 过期时间，0为空槽
+} ip_pmtu_t;
+
+/**
+ * @brief 路径MTU缓存，按目标ip直接映射，冲突时新表项覆盖旧表项（被覆盖的目标重新探测即可）。
+ *        绝大多数目标没有表项，查询只看一个槽，不需要遍历
+ * 
+ */
+static ip_pmtu_t ip_pmtu_cache[IP_PMTU_CACHE_SIZE];
+
+/**
+ * @brief ip标识符计数器桶，每个桶独占一个缓存行，并行发送时互不干扰
+ * 
+ */
+typedef struct ip_id_bucket
+{
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint16_t id;
+} ip_id_bucket_t;
+
+/**
+ * @brief 按<目标ip,协议>散列的ip标识符计数器
+ * 
+ */
+static ip_id_bucket_t ip_id_buckets[IP_ID_BUCKET_NUM];
+
+/**
+ * @brief 为发往目标的数据包生成ip标识符，同一<目标ip,协议>的标识符递增
+ * 
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ * @return uint16_t ip标识符
+ */
+static uint16_t ip_id_next(uint8_t *ip, net_protocol_t protocol)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < NET_IP_LEN; i++)
+        hash = (hash ^ ip[i]) * 16777619u;
+    hash = (hash ^ protocol) * 16777619u;
+    ip_id_bucket_t *bucket = &ip_id_buckets[hash & (IP_ID_BUCKET_NUM - 1)];
+    return atomic_fetch_add_explicit(&bucket->id, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief 目标ip在路径MTU缓存中对应的槽
+ * 
+ * @param ip 目标ip地址
+ * @return ip_pmtu_t* 槽
+ */
+static ip_pmtu_t *ip_pmtu_slot(uint8_t *ip)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < NET_IP_LEN; i++)
+        hash = (hash ^ ip[i]) * 16777619u;
+    return &ip_pmtu_cache[hash & (IP_PMTU_CACHE_SIZE - 1)];
+}
+
+/**
+ * @brief 查找到目标的路径MTU表项，过期的表项在这里清除
+ * 
+ * @param ip 目标ip地址
+ * @return const ip_pmtu_t* 表项，没有时为NULL
+ */
+static const ip_pmtu_t *ip_pmtu_find(uint8_t *ip)
+{
+    ip_pmtu_t *pmtu = ip_pmtu_slot(ip);
+    if (!pmtu->expire || memcmp(pmtu->ip, ip, NET_IP_LEN) != 0)
+        return NULL;
+    if (pmtu->expire < time(NULL))
+    {
+        pmtu->expire = 0;
+        net_pmtu_gen++; // 路径MTU回到网卡MTU，上层重新计算MSS
+        return NULL;
+    }
+    return pmtu;
+}
+
+/**
+ * @brief 表项中的路径MTU，没有表项时为网卡MTU
+ * 
+ * @param pmtu 表项，可以为NULL
+ * @return uint16_t 路径MTU
+ */
+static inline uint16_t ip_pmtu_mtu(const ip_pmtu_t *pmtu)
+{
+    return (pmtu && pmtu->mtu < net_if_mtu) ? pmtu->mtu : net_if_mtu;
+}
 
 /**
  * @brief 处理一个收到的数据包
@@ -15,14 +111,18 @@ void fprint_buf(FILE* f, buf_t* buf);
  */
 void ip_in(buf_t *buf, uint8_t *src_mac)
 {
+    LATENCY_MARK(LATENCY_STAGE_ETHERNET);
     // Step 1: 检查数据包长度是否小于IP头部长度，如果是，则丢弃不处理
     if (buf->len < sizeof(ip_hdr_t)) {
+        stats_inc(STATS_IP_DROP_SHORT);
         return;
     }
+    stats_inc(STATS_IP_RX);
 
     // Step 2: 进行报头检测
     ip_hdr_t *iphdr = (ip_hdr_t *)buf->data;
     if (iphdr->version != IP_VERSION_4 || swap16(iphdr->total_len16) > buf->len) {
+        stats_inc(STATS_IP_DROP_HEADER);
         return;
     }
 
@@ -30,12 +130,14 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
     uint16_t saved_checksum = iphdr->hdr_checksum16;
     iphdr->hdr_checksum16 = 0;
     if (saved_checksum != checksum16((uint16_t *)iphdr, iphdr->hdr_len * IP_HDR_LEN_PER_BYTE)) {
+        stats_inc(STATS_IP_DROP_CHECKSUM);
         return;
     }
     iphdr->hdr_checksum16 = saved_checksum;
 
     // Step 4: 判断目的IP地址是否为本机IP地址，如果不是，则丢弃不处理
     if (memcmp(iphdr->dst_ip, net_if_ip, NET_IP_LEN) != 0) {
+        stats_inc(STATS_IP_DROP_DST);
         return;
     }
 
@@ -60,6 +162,7 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
         //     net_in(buf, iphdr->protocol, iphdr->src_ip);
         //     break;
         default:
+            stats_inc(STATS_IP_DROP_PROTOCOL);
             icmp_unreachable(buf, iphdr->src_ip, ICMP_CODE_PROTOCOL_UNREACH);
             break;
     }
@@ -74,8 +177,9 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
  * @param id 数据包id
  * @param offset 分片offset，必须被8整除
  * @param mf 分片mf标志，是否有下一个分片
+ * @param df 分片df标志，是否禁止路由器分片
  */
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf, int df)
 {
     buf_add_header(buf, sizeof(ip_hdr_t));
 
@@ -86,8 +190,7 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     ip_hdr->tos = 0;
     ip_hdr->total_len16 = swap16(buf->len);
     ip_hdr->id16 = swap16(id);
-    if (mf) ip_hdr->flags_fragment16 = swap16(IP_MORE_FRAGMENT | offset);
-    else    ip_hdr->flags_fragment16 = swap16(offset);
+    ip_hdr->flags_fragment16 = swap16((mf ? IP_MORE_FRAGMENT : 0) | (df ? IP_DONT_FRAGMENT : 0) | offset);
     ip_hdr->ttl = IP_DEFALUT_TTL;
     ip_hdr->protocol = protocol;
     ip_hdr->hdr_checksum16 = 0;
@@ -97,36 +200,39 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
     // 计算IP首部校验和
     uint16_t checksum = checksum16((uint16_t *)ip_hdr, ip_hdr->hdr_len * IP_HDR_LEN_PER_BYTE);
     ip_hdr->hdr_checksum16 = checksum;
-    // fprintf(arp_fout,"###############Personal Log Begin###############\n");
-    // fprintf(arp_fout, "len = %hu", ip_hdr->total_len16);
-    // fprint_buf(arp_fout,buf);
-    // fprintf(arp_fout,"###############Personal Log End###############\n");
     // 发送数据
+    stats_inc(STATS_IP_TX);
     arp_out(buf, ip);
 }
 
 /**
- * @brief 处理一个要发送的ip数据包
+ * @brief 按目标的路径MTU发送一个ip数据包，超过路径MTU时分片发送
  * 
  * @param buf 要处理的包
  * @param ip 目标ip地址
  * @param protocol 上层协议
+ * @param df 不需要分片时是否设置df位
  */
-void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+static void ip_send(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int df)
 {
-    static uint16_t IP_ID = 0;
-    // 检查数据包长度是否超过IP协议最大负载包长
-    if (buf->len > ETHERNET_MAX_TRANSPORT_UNIT-20) {
+    const ip_pmtu_t *pmtu = ip_pmtu_find(ip);
+    if (pmtu && pmtu->no_df)
+        df = 0; // 路径MTU低于下限，带df位的包会一直被丢弃
+    size_t max_len = ip_pmtu_mtu(pmtu) - sizeof(ip_hdr_t);
+    // RFC 6864: 设置了df位且不分片的原子数据包不需要唯一标识符
+    uint16_t id = (df && buf->len <= max_len) ? 0 : ip_id_next(ip, protocol);
+    // 检查数据包长度是否超过路径MTU允许的最大负载包长
+    if (buf->len > max_len) {
+        // 除最后一片外，分片长度必须是8的整数倍
+        size_t frag_max = max_len / IP_HDR_OFFSET_PER_BYTE * IP_HDR_OFFSET_PER_BYTE;
         // 计算分片数目
-        int num_frags = (buf->len) / (ETHERNET_MAX_TRANSPORT_UNIT-20) + 1;
-        // 最后一个分片的长度
-        int last_frag_size = buf->len - (num_frags-1) * (ETHERNET_MAX_TRANSPORT_UNIT-20);
+        int num_frags = (buf->len + frag_max - 1) / frag_max;
         // 分片发送
         for (int i = 0; i < num_frags; i++) {
             // 计算每个分片的偏移量和MF标志
-            int offset = i * (ETHERNET_MAX_TRANSPORT_UNIT-20)/IP_HDR_OFFSET_PER_BYTE;
+            int offset = i * frag_max / IP_HDR_OFFSET_PER_BYTE;
             int mf = (i == num_frags - 1) ? 0 : 1;
-            int frag_size = (i == num_frags - 1) ? last_frag_size : (ETHERNET_MAX_TRANSPORT_UNIT-20);
+            int frag_size = (i == num_frags - 1) ? buf->len : frag_max;
             // 初始化ip_buf
             buf_t ip_buf;
             buf_init(&ip_buf, frag_size);
@@ -134,12 +240,74 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
             memcpy(ip_buf.data, buf->data, frag_size);
             buf_remove_header(buf, frag_size);
             // 发送分片
-            ip_fragment_out(&ip_buf, ip, protocol, IP_ID, offset, mf);
+            ip_fragment_out(&ip_buf, ip, protocol, id, offset, mf, 0);
         }
     } else {
-        ip_fragment_out(buf, ip, protocol, IP_ID, 0, 0);
+        ip_fragment_out(buf, ip, protocol, id, 0, 0, df);
+    }
+}
+
+/**
+ * @brief 处理一个要发送的ip数据包
+ * 
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_send(buf, ip, protocol, 0);
+}
+
+/**
+ * @brief 发送一个设置df位的ip数据包，供自行做路径MTU发现的上层协议（如TCP）使用
+ *        数据包仍超过路径MTU，或路径MTU低于IP_PMTU_MIN时，退化为不带df位的普通发送
+ * 
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ip_out_df(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    ip_send(buf, ip, protocol, 1);
+}
+
+/**
+ * @brief 查询到目标的路径MTU，没有缓存时为网卡MTU
+ * 
+ * @param ip 目标ip地址
+ * @return uint16_t 路径MTU
+ */
+uint16_t ip_pmtu_get(uint8_t *ip)
+{
+    return ip_pmtu_mtu(ip_pmtu_find(ip));
+}
+
+/**
+ * @brief 根据ICMP需要分片报文更新到目标的路径MTU
+ *        只接受比当前值小的MTU，变大依靠缓存过期后重新探测。
+ *        低于IP_PMTU_MIN的MTU只记为下限并标记清除df位（RFC 1191），
+ *        否则带df位的包在这条路径上仍然超长，会一直被丢弃。值有变化时增加net_pmtu_gen
+ * 
+ * @param ip 目标ip地址
+ * @param mtu 下一跳MTU
+ */
+void ip_pmtu_update(uint8_t *ip, uint16_t mtu)
+{
+    uint8_t no_df = 0;
+    if (mtu < IP_PMTU_MIN) {
+        mtu = IP_PMTU_MIN;
+        no_df = 1;
     }
-    IP_ID++;
+    const ip_pmtu_t *old = ip_pmtu_find(ip);
+    if (mtu >= ip_pmtu_mtu(old) && (!no_df || (old && old->no_df)))
+        return;
+    ip_pmtu_t *pmtu = ip_pmtu_slot(ip);
+    memcpy(pmtu->ip, ip, NET_IP_LEN);
+    pmtu->mtu = mtu;
+    pmtu->no_df = no_df;
+    pmtu->expire = time(NULL) + IP_PMTU_TIMEOUT_SEC;
+    net_pmtu_gen++;
 }
 
 /**
@@ -148,5 +316,6 @@ void ip_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
  */
 void ip_init()
 {
+    memset(ip_pmtu_cache, 0, sizeof(ip_pmtu_cache));
     net_add_protocol(NET_PROTOCOL_IP, ip_in);
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "net.h"
+#include "ipv6.h"
+#include "icmpv6.h"
+#include "nd.h"
+#include "stats.h"
+#include "latency.h"
+
+/**
+ * @brief ipv6路径MTU缓存的表项
+ *
+ */
+typedef struct ipv6_pmtu
+{
+    uint8_t ip[NET_IP6_LEN]; // 目标ipv6地址
+    uint16_t mtu;            // 路径MTU，不低于IPV6_MIN_MTU
+    time_t expire;           // 过期时间，0为空槽
+} ipv6_pmtu_t;
+
+/**
+ * @brief ipv6路径MTU缓存，与ipv4的相同，按目标地址直接映射
+ *
+ */
+static ipv6_pmtu_t ipv6_pmtu_cache[IP_PMTU_CACHE_SIZE];
+
+/**
+ * @brief 目标地址在路径MTU缓存中对应的槽
+ *
+ * @param ip 目标ipv6地址
+ * @return ipv6_pmtu_t* 槽
+ */
+static ipv6_pmtu_t *ipv6_pmtu_slot(const uint8_t *ip)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < NET_IP6_LEN; i++)
+        hash = (hash ^ ip[i]) * 16777619u;
+    return &ipv6_pmtu_cache[hash & (IP_PMTU_CACHE_SIZE - 1)];
+}
+
+/**
+ * @brief 全部节点组播地址 ff02::1
+ *
+ */
+static const uint8_t ipv6_all_nodes[NET_IP6_LEN] = {0xff, 0x02, [15] = 0x01};
+
+/**
+ * @brief 判断地址是否为本机地址的被请求节点组播地址 ff02::1:ffXX:XXXX
+ *
+ * @param ip 要判断的地址
+ * @param unicast 本机单播地址
+ * @return int 是为1，否为0
+ */
+static int ipv6_is_solicited_node(const uint8_t *ip, const uint8_t *unicast)
+{
+    static const uint8_t prefix[13] = {0xff, 0x02, [11] = 0x01, [12] = 0xff};
+    return !memcmp(ip, prefix, sizeof(prefix)) && !memcmp(ip + 13, unicast + 13, 3);
+}
+
+/**
+ * @brief 判断目的地址是否发给本机
+ *
+ * @param ip 目的地址
+ * @return int 是为1，否为0
+ */
+static int ipv6_is_mine(const uint8_t *ip)
+{
+    return !memcmp(ip, net_if_ip6, NET_IP6_LEN) ||
+           !memcmp(ip, net_if_ip6_ll, NET_IP6_LEN) ||
+           !memcmp(ip, ipv6_all_nodes, NET_IP6_LEN) ||
+           ipv6_is_solicited_node(ip, net_if_ip6) ||
+           ipv6_is_solicited_node(ip, net_if_ip6_ll);
+}
+
+/**
+ * @brief 为目的地址选择源地址，链路本地范围用链路本地地址，其余用全局地址
+ *
+ * @param dst_ip 目的地址
+ * @return uint8_t* 源地址
+ */
+uint8_t *ipv6_src_for(const uint8_t *dst_ip)
+{
+    if (ipv6_is_link_local(dst_ip) || (ipv6_is_multicast(dst_ip) && (dst_ip[1] & 0x0f) == 0x02))
+        return net_if_ip6_ll;
+    return net_if_ip6;
+}
+
+/**
+ * @brief 计算含ipv6伪头部的上层校验和，伪头部临时写在buf->data之前
+ *
+ * @param buf 上层数据包
+ * @param src_ip 源ip地址
+ * @param dst_ip 目的ip地址
+ * @param next_header 上层协议号
+ * @return uint16_t 校验和
+ */
+uint16_t ipv6_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip, uint8_t next_header)
+{
+    // src_ip/dst_ip可能就指向即将被伪头部覆盖的ipv6头部，先暂存
+    uint8_t src[NET_IP6_LEN], dst[NET_IP6_LEN];
+    memcpy(src, src_ip, NET_IP6_LEN);
+    memcpy(dst, dst_ip, NET_IP6_LEN);
+
+    ipv6_peso_hdr_t *peso_hdr = (ipv6_peso_hdr_t *)(buf->data - sizeof(ipv6_peso_hdr_t));
+    ipv6_peso_hdr_t pre; //暂存被覆盖的数据
+    memcpy(&pre, peso_hdr, sizeof(ipv6_peso_hdr_t));
+    memcpy(peso_hdr->src_ip, src, NET_IP6_LEN);
+    memcpy(peso_hdr->dst_ip, dst, NET_IP6_LEN);
+    peso_hdr->total_len32 = swap32(buf->len);
+    memset(peso_hdr->placeholder, 0, sizeof(peso_hdr->placeholder));
+    peso_hdr->next_header = next_header;
+    uint16_t checksum = checksum16((uint16_t *)peso_hdr, buf->len + sizeof(ipv6_peso_hdr_t));
+    memcpy(peso_hdr, &pre, sizeof(ipv6_peso_hdr_t));
+    return checksum;
+}
+
+/**
+ * @brief 处理一个收到的数据包
+ *
+ * @param buf 要处理的数据包
+ * @param src_mac 源mac地址
+ */
+void ipv6_in(buf_t *buf, uint8_t *src_mac)
+{
+    LATENCY_MARK(LATENCY_STAGE_ETHERNET);
+    if (buf->len < sizeof(ipv6_hdr_t))
+    {
+        stats_inc(STATS_IPV6_DROP_HEADER);
+        return;
+    }
+    stats_inc(STATS_IPV6_RX);
+
+    ipv6_hdr_t *hdr = (ipv6_hdr_t *)buf->data;
+    uint16_t payload_len = swap16(hdr->payload_len16);
+    if (swap32(hdr->ver_tc_flow32) >> 28 != IP_VERSION_6 || payload_len + sizeof(ipv6_hdr_t) > buf->len)
+    {
+        stats_inc(STATS_IPV6_DROP_HEADER);
+        return;
+    }
+
+    if (!ipv6_is_mine(hdr->dst_ip))
+    {
+        stats_inc(STATS_IPV6_DROP_DST);
+        return;
+    }
+
+    // 去除以太网最小帧长带来的填充
+    if (payload_len + sizeof(ipv6_hdr_t) < buf->len)
+        buf_remove_padding(buf, buf->len - payload_len - sizeof(ipv6_hdr_t));
+
+    // 与ipv4一样不做分片重组，分片直接丢弃
+    if (hdr->next_header == IPV6_NEXT_HEADER_FRAGMENT)
+    {
+        stats_inc(STATS_IPV6_DROP_FRAGMENT);
+        return;
+    }
+
+    buf_remove_header(buf, sizeof(ipv6_hdr_t));
+    if (net_in(buf, NET_IPV6_UPPER(hdr->next_header), hdr->src_ip) < 0 && !ipv6_is_multicast(hdr->dst_ip))
+    {
+        // 无法识别的上层协议，指针指向next_header字段
+        stats_inc(STATS_IPV6_DROP_PROTOCOL);
+        buf_add_header(buf, sizeof(ipv6_hdr_t));
+        icmpv6_error(buf, hdr->src_ip, ICMPV6_TYPE_PARAM_PROBLEM, ICMPV6_CODE_UNKNOWN_NEXT_HEADER,
+                     (uint8_t *)&hdr->next_header - (uint8_t *)hdr);
+    }
+}
+
+/**
+ * @brief 添加ipv6头部并交给邻居发现层发送
+ *
+ * @param buf 要发送的包
+ * @param ip 目标ip地址
+ * @param next_header 下一个头部
+ */
+static void ipv6_send(buf_t *buf, uint8_t *ip, uint8_t next_header)
+{
+    // 邻居发现报文的跳数限制必须为255，接收方据此确认报文来自本链路
+    uint8_t hop_limit = IPV6_DEFAULT_HOP_LIMIT;
+    if (next_header == NET_PROTOCOL_ICMPV6 && buf->len > 0 &&
+        (buf->data[0] == ICMPV6_TYPE_NEIGHBOR_SOLICIT || buf->data[0] == ICMPV6_TYPE_NEIGHBOR_ADVERT))
+        hop_limit = ND_HOP_LIMIT;
+
+    size_t payload_len = buf->len;
+    buf_add_header(buf, sizeof(ipv6_hdr_t));
+    ipv6_hdr_t *hdr = (ipv6_hdr_t *)buf->data;
+    hdr->ver_tc_flow32 = swap32((uint32_t)IP_VERSION_6 << 28);
+    hdr->payload_len16 = swap16(payload_len);
+    hdr->next_header = next_header;
+    hdr->hop_limit = hop_limit;
+    memcpy(hdr->src_ip, ipv6_src_for(ip), NET_IP6_LEN);
+    memcpy(hdr->dst_ip, ip, NET_IP6_LEN);
+    stats_inc(STATS_IPV6_TX);
+    nd_out(buf, ip);
+}
+
+/**
+ * @brief 处理一个要发送的ipv6数据包，超过路径MTU时由源端加分片扩展头分片发送
+ *
+ * @param buf 要处理的包
+ * @param ip 目标ip地址
+ * @param protocol 上层协议
+ */
+void ipv6_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol)
+{
+    static uint32_t ipv6_frag_id = 0;
+    size_t max_len = ipv6_pmtu_get(ip) - sizeof(ipv6_hdr_t);
+    if (buf->len <= max_len)
+    {
+        ipv6_send(buf, ip, protocol);
+        return;
+    }
+
+    // 除最后一片外，分片长度必须是8的整数倍
+    size_t frag_max = (max_len - sizeof(ipv6_frag_hdr_t)) / 8 * 8;
+    uint32_t id = ipv6_frag_id++;
+    for (size_t offset = 0; buf->len > 0; offset += frag_max)
+    {
+        size_t frag_size = min32(buf->len, frag_max);
+        buf_t ip_buf;
+        buf_init(&ip_buf, frag_size);
+        memcpy(ip_buf.data, buf->data, frag_size);
+        buf_remove_header(buf, frag_size);
+
+        buf_add_header(&ip_buf, sizeof(ipv6_frag_hdr_t));
+        ipv6_frag_hdr_t *frag_hdr = (ipv6_frag_hdr_t *)ip_buf.data;
+        frag_hdr->next_header = protocol;
+        frag_hdr->reserved = 0;
+        frag_hdr->offset_flags16 = swap16(offset | (buf->len > 0 ? IPV6_MORE_FRAGMENT : 0));
+        frag_hdr->id32 = swap32(id);
+        ipv6_send(&ip_buf, ip, IPV6_NEXT_HEADER_FRAGMENT);
+    }
+}
+
+/**
+ * @brief 查询到目标的路径MTU，没有缓存时为网卡MTU
+ *
+ * @param ip 目标ip地址
+ * @return uint16_t 路径MTU
+ */
+uint16_t ipv6_pmtu_get(uint8_t *ip)
+{
+    ipv6_pmtu_t *pmtu = ipv6_pmtu_slot(ip);
+    if (!pmtu->expire || memcmp(pmtu->ip, ip, NET_IP6_LEN) != 0)
+        return net_if_mtu;
+    if (pmtu->expire < time(NULL))
+    {
+        pmtu->expire = 0;
+        net_pmtu_gen++; // 路径MTU回到网卡MTU，上层重新计算MSS
+        return net_if_mtu;
+    }
+    return pmtu->mtu < net_if_mtu ? pmtu->mtu : net_if_mtu;
+}
+
+/**
+ * @brief 根据ICMPv6数据包过大报文更新到目标的路径MTU
+ *        只接受比当前值小的MTU，且不低于ipv6最小MTU
+ *
+ * @param ip 目标ip地址
+ * @param mtu 报文中携带的MTU
+ */
+void ipv6_pmtu_update(uint8_t *ip, uint32_t mtu)
+{
+    if (mtu < IPV6_MIN_MTU)
+        mtu = IPV6_MIN_MTU;
+    if (mtu >= ipv6_pmtu_get(ip))
+        return;
+    ipv6_pmtu_t *pmtu = ipv6_pmtu_slot(ip);
+    memcpy(pmtu->ip, ip, NET_IP6_LEN);
+    pmtu->mtu = mtu;
+    pmtu->expire = time(NULL) + IP_PMTU_TIMEOUT_SEC;
+    net_pmtu_gen++;
+}
+
+/**
+ * @brief 初始化ipv6协议，由mac地址按EUI-64生成链路本地地址
+ *
+ */
+void ipv6_init()
+{
+    memset(net_if_ip6_ll, 0, NET_IP6_LEN);
+    net_if_ip6_ll[0] = 0xfe;
+    net_if_ip6_ll[1] = 0x80;
+    net_if_ip6_ll[8] = net_if_mac[0] ^ 0x02;
+    net_if_ip6_ll[9] = net_if_mac[1];
+    net_if_ip6_ll[10] = net_if_mac[2];
+    net_if_ip6_ll[11] = 0xff;
+    net_if_ip6_ll[12] = 0xfe;
+    net_if_ip6_ll[13] = net_if_mac[3];
+    net_if_ip6_ll[14] = net_if_mac[4];
+    net_if_ip6_ll[15] = net_if_mac[5];
+
+    memset(ipv6_pmtu_cache, 0, sizeof(ipv6_pmtu_cache));
+    net_add_protocol(NET_PROTOCOL_IPV6, ipv6_in);
+}
@@ -0,0 +1,166 @@
+#include "latency.h"
+
+#ifdef LATENCY
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief 当前数据包的起始时间戳与上一个边界的时间戳，为0表示不在测量中
+ *
+ */
+_Thread_local uint64_t latency_start, latency_last;
+
+/**
+ * @brief 各阶段的直方图
+ *
+ */
+static latency_hist_t latency_hists[LATENCY_STAGE_NUM];
+
+/**
+ * @brief 每纳秒的时间戳数，由latency_init校准
+ *
+ */
+static double latency_ticks_per_ns = 1.0;
+
+static const char *latency_stage_names[LATENCY_STAGE_NUM] = {
+    [LATENCY_STAGE_ETHERNET] = "ethernet",
+    [LATENCY_STAGE_IP] = "ip",
+    [LATENCY_STAGE_TRANSPORT] = "transport",
+    [LATENCY_STAGE_HANDLER] = "handler",
+    [LATENCY_STAGE_TOTAL] = "total",
+    [LATENCY_STAGE_TX_WAIT] = "tcp tx wait",
+};
+
+/**
+ * @brief 取单调时钟的纳秒数
+ *
+ * @return uint64_t 纳秒
+ */
+static uint64_t latency_clock_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief 初始化延迟测量，用单调时钟校准TSC频率
+ *
+ */
+void latency_init()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ns0 = latency_clock_ns(), tick0 = latency_now();
+    while (latency_clock_ns() - ns0 < LATENCY_CALIBRATE_NS)
+        ;
+    uint64_t ns1 = latency_clock_ns(), tick1 = latency_now();
+    latency_ticks_per_ns = (double)(tick1 - tick0) / (ns1 - ns0);
+#endif
+    latency_reset();
+}
+
+/**
+ * @brief 清空全部直方图
+ *
+ */
+void latency_reset()
+{
+    memset(latency_hists, 0, sizeof(latency_hists));
+}
+
+/**
+ * @brief 计算取值所在的桶
+ *        小于2*LATENCY_SUB_BUCKET_NUM的值一个值一个桶，之后每个2的幂区间分LATENCY_SUB_BUCKET_NUM个桶
+ *
+ * @param value 取值
+ * @return int 桶下标
+ */
+static inline int latency_bucket_index(uint64_t value)
+{
+    if (value < 2 * LATENCY_SUB_BUCKET_NUM)
+        return value;
+    int shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BUCKET_BITS;
+    return shift * LATENCY_SUB_BUCKET_NUM + (value >> shift);
+}
+
+/**
+ * @brief 桶的代表值，取桶内区间的中点
+ *
+ * @param index 桶下标
+ * @return uint64_t 代表值
+ */
+static uint64_t latency_bucket_value(int index)
+{
+    if (index < 2 * LATENCY_SUB_BUCKET_NUM)
+        return index;
+    int shift = index / LATENCY_SUB_BUCKET_NUM - 1;
+    uint64_t sub = index - shift * LATENCY_SUB_BUCKET_NUM;
+    return (sub << shift) + ((1ull << shift) >> 1);
+}
+
+/**
+ * @brief 记录一次耗时
+ *
+ * @param stage 阶段
+ * @param ticks 耗时的时间戳数
+ */
+void latency_record(latency_stage_t stage, uint64_t ticks)
+{
+    latency_hist_t *hist = &latency_hists[stage];
+    hist->buckets[latency_bucket_index(ticks)]++;
+    hist->count++;
+    if (ticks > hist->max)
+        hist->max = ticks;
+}
+
+/**
+ * @brief 查询阶段耗时的百分位数
+ *
+ * @param stage 阶段
+ * @param percentile 百分位，如99.9
+ * @return uint64_t 耗时纳秒数，没有记录时为0
+ */
+uint64_t latency_percentile(latency_stage_t stage, double percentile)
+{
+    latency_hist_t *hist = &latency_hists[stage];
+    if (hist->count == 0)
+        return 0;
+    uint64_t target = (uint64_t)(hist->count * percentile / 100.0 + 0.5);
+    if (target == 0)
+        target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKET_NUM; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= target)
+        {
+            uint64_t value = latency_bucket_value(i);
+            return (value < hist->max ? value : hist->max) / latency_ticks_per_ns;
+        }
+    }
+    return hist->max / latency_ticks_per_ns;
+}
+
+/**
+ * @brief 打印各阶段的p50/p99/p999与最大值，单位纳秒
+ *
+ * @param fp 输出文件
+ */
+void latency_report(FILE *fp)
+{
+    fprintf(fp, "===LATENCY BEGIN===\n");
+    fprintf(fp, "%-12s %10s %10s %10s %10s %10s\n", "stage", "count", "p50", "p99", "p999", "max");
+    for (int i = 0; i < LATENCY_STAGE_NUM; i++)
+    {
+        latency_hist_t *hist = &latency_hists[i];
+        fprintf(fp, "%-12s %10llu %10llu %10llu %10llu %10llu\n", latency_stage_names[i],
+                (unsigned long long)hist->count,
+                (unsigned long long)latency_percentile(i, 50),
+                (unsigned long long)latency_percentile(i, 99),
+                (unsigned long long)latency_percentile(i, 99.9),
+                (unsigned long long)(hist->max / latency_ticks_per_ns));
+    }
+    fprintf(fp, "===LATENCY  END ===\n");
+}
+
+#endif
@@ -0,0 +1,127 @@
+#include "log.h"
+#include "net.h"
+
+/**
+ * @brief 日志环，协议栈只写入二进制记录，格式化和输出由log_drain完成
+ *
+ */
+log_ring_t log_ring;
+
+/**
+ * @brief 记录中addr字段的解释方式
+ *
+ */
+typedef enum log_addr_type
+{
+    LOG_ADDR_NONE,
+    LOG_ADDR_MAC,
+    LOG_ADDR_IP, // 按长度区分ipv4和ipv6
+    LOG_ADDR_TEXT,
+} log_addr_type_t;
+
+typedef struct log_event_desc
+{
+    log_addr_type_t addr_type;
+    const char *fmt; // 依次使用args[0..2]
+} log_event_desc_t;
+
+/**
+ * @brief 事件表，格式串只在解码时使用
+ *
+ */
+static const log_event_desc_t log_events[LOG_EVENT_NUM] = {
+    [LOG_EVENT_ETH_SHORT_FRAME] = {LOG_ADDR_NONE, "eth: frame shorter than header, len=%u"},
+    [LOG_EVENT_ETH_SHORT_VLAN] = {LOG_ADDR_MAC, "eth: incomplete vlan tag"},
+    [LOG_EVENT_ETH_OVER_MTU] = {LOG_ADDR_MAC, "eth: frame larger than mtu, len=%u mtu=%u"},
+    [LOG_EVENT_ETH_UNKNOWN_VLAN] = {LOG_ADDR_MAC, "eth: unknown vlan %u"},
+    [LOG_EVENT_ETH_UNKNOWN_PROTOCOL] = {LOG_ADDR_MAC, "eth: no handler for protocol 0x%04x"},
+    [LOG_EVENT_ETH_PADDING_FAILED] = {LOG_ADDR_MAC, "eth: buf_add_padding failed, len=%u"},
+    [LOG_EVENT_ETH_HEADER_FAILED] = {LOG_ADDR_MAC, "eth: buf_add_header failed, len=%u"},
+    [LOG_EVENT_ETH_SEND_FAILED] = {LOG_ADDR_MAC, "eth: driver_send failed, len=%u"},
+    [LOG_EVENT_TCP_SEND] = {LOG_ADDR_IP, "tcp send %u -> %u flags:"},
+    [LOG_EVENT_TCP_RESET] = {LOG_ADDR_IP, "tcp reset %u -> %u"},
+    [LOG_EVENT_UDP_RECV] = {LOG_ADDR_IP, "recv udp packet from port %u len=%u"},
+    [LOG_EVENT_TCP_RECV] = {LOG_ADDR_IP, "recv tcp packet from port %u len=%u"},
+    [LOG_EVENT_APP_DATA] = {LOG_ADDR_TEXT, "data len=%u"},
+    [LOG_EVENT_HTTP_CONNECTED] = {LOG_ADDR_IP, "http connected, port %u"},
+    [LOG_EVENT_HTTP_CLOSED] = {LOG_ADDR_IP, "http closed, port %u"},
+    [LOG_EVENT_HTTP_FINAL_CLOSE] = {LOG_ADDR_NONE, "http final close"},
+};
+
+static const char *log_level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+/**
+ * @brief 把一条记录格式化输出
+ *
+ * @param fp 输出文件
+ * @param record 日志记录
+ */
+static void log_print(FILE *fp, log_record_t *record)
+{
+    fprintf(fp, "%s.%06d [%s] ", timetos(record->sec), record->nsec / 1000,
+            record->level < LOG_LEVEL_NONE ? log_level_names[record->level] : "?");
+    if (record->event >= LOG_EVENT_NUM)
+    {
+        fprintf(fp, "unknown event %u\n", record->event);
+        return;
+    }
+
+    const log_event_desc_t *desc = &log_events[record->event];
+    switch (desc->addr_type)
+    {
+    case LOG_ADDR_MAC:
+        if (record->addr_len == NET_MAC_LEN)
+            fprintf(fp, "%s ", mactos(record->addr));
+        break;
+    case LOG_ADDR_IP:
+        if (record->addr_len == NET_IP_LEN)
+            fprintf(fp, "%s ", iptos(record->addr));
+        else if (record->addr_len == NET_IP6_LEN)
+            fprintf(fp, "[%s] ", ip6tos(record->addr));
+        break;
+    default:
+        break;
+    }
+    fprintf(fp, desc->fmt, record->args[0], record->args[1], record->args[2]);
+
+    if (record->event == LOG_EVENT_TCP_SEND)
+    {
+        // args[2]为tcp头部的标志字节
+        static const char *flag_names[] = {" fin", " syn", " rst", " psh", " ack", " urg", " ece", " cwr"};
+        for (int i = 7; i >= 0; i--)
+            if (record->args[2] & (1 << i))
+                fputs(flag_names[i], fp);
+    }
+    else if (desc->addr_type == LOG_ADDR_TEXT)
+    {
+        fputs(" \"", fp);
+        for (int i = 0; i < record->addr_len; i++)
+            fputc(record->addr[i] >= 0x20 && record->addr[i] < 0x7f ? record->addr[i] : '.', fp);
+        fputc('"', fp);
+    }
+    fputc('\n', fp);
+}
+
+/**
+ * @brief 取出并输出日志环中的记录，由应用在主循环中和退出时调用，协议栈自身不做输出
+ *
+ * @param fp 输出文件
+ * @param max 本次最多输出的记录数
+ * @return size_t 输出的记录数
+ */
+size_t log_drain(FILE *fp, size_t max)
+{
+    size_t tail = atomic_load_explicit(&log_ring.tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&log_ring.head, memory_order_acquire);
+    size_t count = 0;
+    for (; tail != head && count < max; tail++, count++)
+        log_print(fp, &log_ring.records[tail & (LOG_RING_LEN - 1)]);
+    atomic_store_explicit(&log_ring.tail, tail, memory_order_release);
+
+    size_t dropped = atomic_exchange_explicit(&log_ring.dropped, 0, memory_order_relaxed);
+    if (dropped)
+        fprintf(fp, "log ring full, %zu records dropped\n", dropped);
+    if (count || dropped)
+        fflush(fp);
+    return count;
+}
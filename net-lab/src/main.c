@@ -1,9 +1,12 @@
 #include "net.h"
 #include "udp.h"
 #include "tcp.h"
+#include "ipv6.h"
 #include "http.h"
 #include "driver.h"
 #include "time.h"
+#include "log.h"
+#include "stats.h"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat="
@@ -13,12 +16,17 @@
 #ifdef UDP
 void udp_handler(uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
 {
-    printf("recv udp packet from %s:%u len=%zu\n", iptos(src_ip), src_port, len);
-    for (int i = 0; i < len; i++)
-        putchar(data[i]);
-    putchar('\n');
+    LOG_INFO(LOG_EVENT_UDP_RECV, src_ip, NET_IP_LEN, src_port, len, 0);
+    LOG_DEBUG(LOG_EVENT_APP_DATA, data, len, len, 0, 0);
     udp_send(data, len, 60000, src_ip, src_port); //发送udp包
 }
+
+void udp6_handler(uint8_t* data, size_t len, uint8_t* src_ip, uint16_t src_port) 
+{
+    LOG_INFO(LOG_EVENT_UDP_RECV, src_ip, NET_IP6_LEN, src_port, len, 0);
+    LOG_DEBUG(LOG_EVENT_APP_DATA, data, len, len, 0, 0);
+    udp6_send(data, len, 60000, src_ip, src_port); //发送udp包
+}
 #endif
 
 #ifdef TCP
@@ -26,15 +34,29 @@ void tcp_handler(tcp_connect_t* connect, connect_state_t state) {
     uint8_t buf[512];
     size_t len = tcp_connect_read(connect, buf, sizeof(buf) - 1);
     buf[len] = 0;
-    printf("recv tcp packet from %s:%u len=%zu\n",
-        iptos(connect->ip), connect->remote_port, len);
-    printf("%s\n", buf);
+    LOG_INFO(LOG_EVENT_TCP_RECV, connect->ip, connect->version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN,
+             connect->remote_port, len, 0);
+    LOG_DEBUG(LOG_EVENT_APP_DATA, buf, len, len, 0, 0);
     tcp_connect_write(connect, buf, len);
 }
 #endif
 
+#if LOG_LEVEL < LOG_LEVEL_NONE
+/**
+ * @brief 退出时输出日志环中剩余的记录
+ *
+ */
+static void log_flush(void)
+{
+    log_drain(stdout, LOG_RING_LEN);
+}
+#endif
+
 int main(int argc, char const *argv[])
 {
+#if LOG_LEVEL < LOG_LEVEL_NONE
+    atexit(log_flush);
+#endif
 
     if (net_init() != 0)
 	{
@@ -43,6 +65,13 @@ int main(int argc, char const *argv[])
     }
 #ifdef UDP
     udp_open(60000, udp_handler); //注册端口的udp监听回调
+#ifdef IPV6
+    udp6_open(60000, udp6_handler);
+#endif
+#if STATS_PORT
+    uint8_t stats_allow_ip[] = STATS_ALLOW_IP;
+    stats_open(STATS_PORT, stats_allow_ip); //在udp端口上提供计数器查询，默认不开启
+#endif
 #endif
 #ifdef TCP
     tcp_open(61000, tcp_handler); //注册端口的tcp监听回调
@@ -56,6 +85,9 @@ int main(int argc, char const *argv[])
         net_poll(); //一次主循环
 #ifdef HTTP
         http_server_run();
+#endif
+#if LOG_LEVEL < LOG_LEVEL_NONE
+        log_drain(stdout, LOG_DRAIN_BATCH); //在协议栈之外格式化输出日志
 #endif
         // 节约用电
         struct timespec sleepTime = { 0, 1000000 };
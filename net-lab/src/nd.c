@@ -0,0 +1,218 @@
+#include <string.h>
+#include <stdio.h>
+#include "net.h"
+#include "nd.h"
+#include "ipv6.h"
+#include "icmpv6.h"
+#include "ethernet.h"
+#include "stats.h"
+
+/**
+ * @brief 邻居缓存，<(ipv6,vlan),mac>的容器，取代ipv4中的arp表
+ *
+ */
+map_t nd_table;
+
+/**
+ * @brief 等待地址解析的数据包，<(ipv6,vlan),buf_t>的容器
+ *
+ */
+map_t nd_buf;
+
+/**
+ * @brief 当前收发所在vlan上ipv6地址对应的键
+ *
+ * @param ip ipv6地址
+ * @return nd_key_t 键
+ */
+static nd_key_t nd_key(const uint8_t *ip)
+{
+    nd_key_t key;
+    memcpy(key.ip, ip, NET_IP6_LEN);
+    key.vid = net_if_vlan;
+    return key;
+}
+
+/**
+ * @brief 打印一条邻居缓存表项
+ *
+ * @param ip 表项的ipv6地址
+ * @param mac 表项的mac地址
+ * @param timestamp 表项的更新时间
+ */
+void nd_entry_print(void *ip, void *mac, time_t *timestamp)
+{
+    printf("%s | %s | %s\n", ip6tos(ip), mactos(mac), timetos(*timestamp));
+}
+
+/**
+ * @brief 打印整个邻居缓存
+ *
+ */
+void nd_print()
+{
+    printf("===ND TABLE BEGIN===\n");
+    map_foreach(&nd_table, nd_entry_print);
+    printf("===ND TABLE  END ===\n");
+}
+
+/**
+ * @brief 由组播ipv6地址得到组播mac地址 33:33:xx:xx:xx:xx
+ *
+ * @param ip 组播ipv6地址
+ * @param mac 出口参数，组播mac地址
+ */
+static void nd_multicast_mac(const uint8_t *ip, uint8_t *mac)
+{
+    mac[0] = 0x33;
+    mac[1] = 0x33;
+    memcpy(mac + 2, ip + 12, 4);
+}
+
+/**
+ * @brief 填写邻居发现报文并发送
+ *
+ * @param type 邻居请求或邻居通告
+ * @param flags 通告的R/S/O标志
+ * @param target_ip 报文中的目标地址
+ * @param dst_ip ipv6目的地址
+ * @param opt_type 携带的链路层地址选项类型
+ */
+static void nd_send(icmpv6_type_t type, uint32_t flags, uint8_t *target_ip, uint8_t *dst_ip, uint8_t opt_type)
+{
+    buf_init(&txbuf, sizeof(nd_pkt_t));
+    nd_pkt_t *pkt = (nd_pkt_t *)txbuf.data;
+    pkt->type = type;
+    pkt->code = 0;
+    pkt->checksum16 = 0;
+    pkt->flags32 = swap32(flags);
+    memcpy(pkt->target_ip, target_ip, NET_IP6_LEN);
+    pkt->opt_type = opt_type;
+    pkt->opt_len = 1;
+    memcpy(pkt->opt_mac, net_if_mac, NET_MAC_LEN);
+    pkt->checksum16 = ipv6_checksum(&txbuf, ipv6_src_for(dst_ip), dst_ip, NET_PROTOCOL_ICMPV6);
+    stats_inc(STATS_ICMPV6_TX);
+    ipv6_out(&txbuf, dst_ip, NET_PROTOCOL_ICMPV6);
+}
+
+/**
+ * @brief 发送一个邻居请求，目的地址为目标的被请求节点组播地址
+ *
+ * @param target_ip 想要知道的目标的ipv6地址
+ */
+void nd_req(uint8_t *target_ip)
+{
+    uint8_t dst_ip[NET_IP6_LEN] = {0xff, 0x02, [11] = 0x01, [12] = 0xff};
+    memcpy(dst_ip + 13, target_ip + 13, 3);
+    nd_send(ICMPV6_TYPE_NEIGHBOR_SOLICIT, 0, target_ip, dst_ip, ND_OPT_SOURCE_MAC);
+}
+
+/**
+ * @brief 发送一个邻居通告
+ *
+ * @param target_ip 被请求的本机地址
+ * @param dst_ip 请求者的地址
+ */
+void nd_resp(uint8_t *target_ip, uint8_t *dst_ip)
+{
+    nd_send(ICMPV6_TYPE_NEIGHBOR_ADVERT, ND_FLAG_SOLICITED | ND_FLAG_OVERRIDE, target_ip, dst_ip, ND_OPT_TARGET_MAC);
+}
+
+/**
+ * @brief 处理一个收到的邻居发现报文
+ *
+ * @param buf 要处理的数据包，从ICMPv6头部开始
+ * @param src_ip 源ipv6地址
+ */
+void nd_in(buf_t *buf, uint8_t *src_ip)
+{
+    if (buf->len < sizeof(nd_pkt_t) - NET_MAC_LEN - 2)
+        return;
+
+    // ipv6_in去掉头部后头部仍在buf->data之前，检查跳数限制确认报文来自本链路
+    ipv6_hdr_t *ip_hdr = (ipv6_hdr_t *)(buf->data - sizeof(ipv6_hdr_t));
+    nd_pkt_t *pkt = (nd_pkt_t *)buf->data;
+    if (ip_hdr->hop_limit != ND_HOP_LIMIT || pkt->code != 0)
+        return;
+
+    // 查找链路层地址选项
+    uint8_t *mac = NULL;
+    for (size_t off = sizeof(nd_pkt_t) - NET_MAC_LEN - 2; off + 2 <= buf->len;)
+    {
+        uint8_t opt_type = buf->data[off], opt_len = buf->data[off + 1] * 8;
+        if (opt_len == 0 || off + opt_len > buf->len)
+            return;
+        if ((opt_type == ND_OPT_SOURCE_MAC || opt_type == ND_OPT_TARGET_MAC) && opt_len >= 2 + NET_MAC_LEN)
+            mac = buf->data + off + 2;
+        off += opt_len;
+    }
+
+    uint8_t target_ip[NET_IP6_LEN];
+    memcpy(target_ip, pkt->target_ip, NET_IP6_LEN);
+    uint8_t *neighbor_ip = pkt->type == ICMPV6_TYPE_NEIGHBOR_SOLICIT ? src_ip : target_ip;
+    static const uint8_t unspecified[NET_IP6_LEN] = {0};
+    if (mac && memcmp(neighbor_ip, unspecified, NET_IP6_LEN))
+    {
+        uint8_t neighbor_mac[NET_MAC_LEN];
+        memcpy(neighbor_mac, mac, NET_MAC_LEN);
+        nd_key_t key = nd_key(neighbor_ip); // 收包时net_if_vlan是这一帧所在的vlan
+        map_set(&nd_table, &key, neighbor_mac);
+
+        // 有等待该地址解析的数据包则发出去
+        buf_t *pending = map_get(&nd_buf, &key);
+        if (pending)
+        {
+            ethernet_out(pending, neighbor_mac, NET_PROTOCOL_IPV6);
+            map_delete(&nd_buf, &key);
+        }
+    }
+
+    if (pkt->type == ICMPV6_TYPE_NEIGHBOR_SOLICIT &&
+        (!memcmp(target_ip, net_if_ip6, NET_IP6_LEN) || !memcmp(target_ip, net_if_ip6_ll, NET_IP6_LEN)))
+    {
+        // 重复地址检测的请求源地址为::，通告发往全部节点
+        uint8_t dst_ip[NET_IP6_LEN] = {0xff, 0x02, [15] = 0x01};
+        if (memcmp(src_ip, unspecified, NET_IP6_LEN))
+            memcpy(dst_ip, src_ip, NET_IP6_LEN);
+        nd_resp(target_ip, dst_ip);
+    }
+}
+
+/**
+ * @brief 处理一个要发送的数据包
+ *
+ * @param buf 要处理的数据包
+ * @param ip 目标ipv6地址
+ */
+void nd_out(buf_t *buf, uint8_t *ip)
+{
+    if (ipv6_is_multicast(ip))
+    {
+        uint8_t mac[NET_MAC_LEN];
+        nd_multicast_mac(ip, mac);
+        ethernet_out(buf, mac, NET_PROTOCOL_IPV6);
+        return;
+    }
+    nd_key_t key = nd_key(ip); // 在当前发包所在的vlan上解析
+    uint8_t *target_mac = map_get(&nd_table, &key);
+    if (target_mac)
+    {
+        ethernet_out(buf, target_mac, NET_PROTOCOL_IPV6);
+    }
+    else if (map_get(&nd_buf, &key) == NULL)
+    {
+        // 与arp_out相同，同一地址只缓存一个包，等待邻居通告
+        map_set(&nd_buf, &key, buf);
+        nd_req(key.ip);
+    }
+}
+
+/**
+ * @brief 初始化邻居发现
+ *
+ */
+void nd_init()
+{
+    map_init(&nd_table, sizeof(nd_key_t), NET_MAC_LEN, 0, ND_TIMEOUT_SEC, NULL);
+    map_init(&nd_buf, sizeof(nd_key_t), sizeof(buf_t), 0, ND_MIN_INTERVAL, buf_copy);
+}
@@ -3,15 +3,26 @@
 #include "ethernet.h"
 #include "arp.h"
 #include "ip.h"
+#include "ipv6.h"
+#include "nd.h"
 #include "icmp.h"
+#include "icmpv6.h"
 #include "udp.h"
 #include "tcp.h"
+#include "latency.h"
+#include "timer.h"
 
 /**
- * @brief 协议表 <协议号,处理程序>的容器
+ * @brief 上层协议表，按ip协议号直接索引，前256项为ipv4上层协议，后256项为ipv6上层协议
  * 
  */
-map_t net_table;
+static net_handler_t net_upper_table[2 * NET_UPPER_PROTOCOL_NUM];
+
+/**
+ * @brief 以太网协议表，下标由net_ethertype_index得到
+ * 
+ */
+static net_handler_t net_ethertype_table[NET_ETHERTYPE_NUM];
 
 /**
  * @brief 网卡MAC地址
@@ -25,6 +36,43 @@ uint8_t net_if_mac[NET_MAC_LEN] = NET_IF_MAC;
  */
 uint8_t net_if_ip[NET_IP_LEN] = NET_IF_IP;
 
+/**
+ * @brief 网卡ipv6全局地址
+ * 
+ */
+uint8_t net_if_ip6[NET_IP6_LEN] = NET_IF_IP6;
+
+/**
+ * @brief 网卡ipv6链路本地地址，由ipv6_init根据mac地址生成
+ * 
+ */
+uint8_t net_if_ip6_ll[NET_IP6_LEN];
+
+/**
+ * @brief 网卡MTU
+ * 
+ */
+uint16_t net_if_mtu = NET_IF_MTU;
+
+/**
+ * @brief 网卡MTU或任一路径MTU变化时加一，上层比较它决定是否重新计算缓存的MSS
+ * 
+ */
+uint32_t net_pmtu_gen;
+
+/**
+ * @brief vlan子接口表，下标为vlan id，0号为不带标签的本接口
+ * 
+ */
+static net_vlan_t net_vlan_table[NET_VLAN_MAX];
+
+/**
+ * @brief 当前收发所在的vlan，0为不带标签，发包时ethernet_out据此打标签，arp和邻居缓存按它区分。
+ *        ethernet_in只在处理一帧期间切换到该帧的vlan，处理完回到0；TCP连接记住自己的vlan，发包时临时切换
+ * 
+ */
+uint16_t net_if_vlan = 0;
+
 /**
  * @brief 网卡接收和发送缓冲区
  * 
@@ -37,11 +85,21 @@ buf_t rxbuf, txbuf; //一个buf足够单线程使用
  */
 int net_init()
 {
-    map_init(&net_table, sizeof(uint16_t), sizeof(net_handler_t), 0, 0, NULL);
+    net_vlan_table[0].valid = 1;
+    memcpy(net_vlan_table[0].ip, net_if_ip, NET_IP_LEN);
+    timer_init();
+#ifdef LATENCY
+    latency_init();
+#endif
     if (driver_open() == -1)
         return -1;
 #ifdef ETHERNET
     ethernet_init();
+#ifdef IPV6
+    ipv6_init();
+    nd_init();
+    icmpv6_init();
+#endif
 #ifdef ARP
     arp_init();
 #ifdef IP
@@ -61,6 +119,41 @@ int net_init()
     return 0;
 }
 
+/**
+ * @brief 以太网协议号到以太网协议表下标的映射
+ * 
+ * @param protocol 以太网协议号
+ * @return int 下标，不支持的协议为-1
+ */
+static inline int net_ethertype_index(uint16_t protocol)
+{
+    switch (protocol)
+    {
+    case NET_PROTOCOL_IP:
+        return 0;
+    case NET_PROTOCOL_ARP:
+        return 1;
+    case NET_PROTOCOL_IPV6:
+        return 2;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief 取协议号对应的处理程序表项，小于0x200的是ip上层协议（含NET_IPV6_UPPER），其余是以太网协议
+ * 
+ * @param protocol 协议号
+ * @return net_handler_t* 表项，不支持的协议为NULL
+ */
+static inline net_handler_t *net_handler_slot(uint16_t protocol)
+{
+    if (protocol < 2 * NET_UPPER_PROTOCOL_NUM)
+        return &net_upper_table[protocol];
+    int index = net_ethertype_index(protocol);
+    return index < 0 ? NULL : &net_ethertype_table[index];
+}
+
 /**
  * @brief 向协议栈注册一个协议
  * 
@@ -69,7 +162,87 @@ int net_init()
  */
 void net_add_protocol(uint16_t protocol, net_handler_t handler)
 {
-    map_set(&net_table, &protocol, &handler);
+    net_handler_t *slot = net_handler_slot(protocol);
+    if (slot == NULL)
+    {
+        fprintf(stderr, "Error in net_add_protocol: unsupported protocol 0x%04x.\n", protocol);
+        return;
+    }
+    *slot = handler;
+}
+
+/**
+ * @brief 设置网卡MTU，大于ETHERNET_MAX_TRANSPORT_UNIT即启用巨型帧
+ * 
+ * @param mtu 新的MTU
+ * @return int 成功为0，失败为-1
+ */
+int net_if_set_mtu(uint16_t mtu)
+{
+    if (mtu < IP_PMTU_MIN || mtu > ETHERNET_MAX_JUMBO_UNIT)
+        return -1;
+    net_if_mtu = mtu;
+    net_pmtu_gen++;
+    return 0;
+}
+
+/**
+ * @brief 配置一个vlan子接口，并更新驱动的过滤规则使其接收该vlan
+ * 
+ * @param vid vlan id，1~4094
+ * @param ip 该vlan上的ip地址
+ * @return int 成功为0，失败为-1
+ */
+int net_vlan_add(uint16_t vid, uint8_t *ip)
+{
+    if (vid == 0 || vid >= NET_VLAN_MAX - 1)
+        return -1;
+    net_vlan_table[vid].valid = 1;
+    memcpy(net_vlan_table[vid].ip, ip, NET_IP_LEN);
+    return driver_update_filter();
+}
+
+/**
+ * @brief 删除一个vlan子接口
+ * 
+ * @param vid vlan id
+ */
+void net_vlan_delete(uint16_t vid)
+{
+    if (vid == 0 || vid >= NET_VLAN_MAX)
+        return;
+    net_vlan_table[vid].valid = 0;
+    if (net_if_vlan == vid)
+        net_if_select(0);
+    driver_update_filter();
+}
+
+/**
+ * @brief 判断vlan子接口是否已配置
+ * 
+ * @param vid vlan id
+ * @return int 已配置为1，否则为0
+ */
+int net_vlan_valid(uint16_t vid)
+{
+    return vid < NET_VLAN_MAX && net_vlan_table[vid].valid;
+}
+
+/**
+ * @brief 切换当前收发所在的vlan子接口，net_if_ip随之切换为该子接口的地址
+ * 
+ * @param vid vlan id，0为不带标签
+ * @return int 成功为0，vlan未配置为-1
+ */
+int net_if_select(uint16_t vid)
+{
+    if (vid == net_if_vlan)
+        return 0;
+    if (!net_vlan_valid(vid))
+        return -1;
+    net_if_vlan = vid;
+    memcpy(net_if_ip, net_vlan_table[vid].ip, NET_IP_LEN);
+    return 0;
 }
 
 /**
@@ -82,8 +255,8 @@ void net_add_protocol(uint16_t protocol, net_handler_t handler)
  */
 int net_in(buf_t *buf, uint16_t protocol, uint8_t *src)
 {
-    net_handler_t *handler = map_get(&net_table, &protocol);
-    if (handler)
+    net_handler_t *handler = net_handler_slot(protocol);
+    if (handler && *handler)
     {
         (*handler)(buf, src);
         return 0;
@@ -100,4 +273,8 @@ void net_poll()
 #ifdef ETHERNET
     ethernet_poll();
 #endif
+#ifdef TCP
+    tcp_flush_acks(); //一批包处理完后再发出这批包需要的ACK，每个连接最多一个
+#endif
+    timer_poll(); //收包处理完后再处理到期的定时器
 }
\ No newline at end of file
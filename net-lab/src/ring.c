@@ -0,0 +1,153 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * @brief 分配环的存储区
+ *
+ * @param ring 要初始化的环
+ * @param size 容量，必须是2的幂
+ * @return int 成功为0，失败为-1
+ */
+int ring_init(ring_t *ring, uint32_t size)
+{
+    assert(size && (size & (size - 1)) == 0);
+    ring->data = malloc(size);
+    if (!ring->data)
+        return -1;
+    ring->size = size;
+    ring->head = ring->tail = 0;
+    return 0;
+}
+
+/**
+ * @brief 清空环，保留存储区
+ *
+ * @param ring 环
+ */
+void ring_reset(ring_t *ring)
+{
+    ring->head = ring->tail = 0;
+}
+
+/**
+ * @brief 释放环的存储区
+ *
+ * @param ring 环
+ */
+void ring_free(ring_t *ring)
+{
+    free(ring->data);
+    ring->data = NULL;
+    ring->size = 0;
+    ring->head = ring->tail = 0;
+}
+
+/**
+ * @brief 把len字节拷贝到环中从pos开始的位置，回绕时分两段
+ *
+ * @param ring 环
+ * @param pos 自由增长的位置
+ * @param src 数据
+ * @param len 字节数，不超过容量
+ */
+static void ring_copy_in(ring_t *ring, uint32_t pos, const uint8_t *src, uint32_t len)
+{
+    uint32_t index = pos & (ring->size - 1);
+    uint32_t first = ring->size - index < len ? ring->size - index : len;
+    memcpy(ring->data + index, src, first);
+    memcpy(ring->data, src + first, len - first);
+}
+
+/**
+ * @brief 在已有数据之后追加数据，空间不够时只写入能放下的部分
+ *
+ * @param ring 环
+ * @param src 数据
+ * @param len 字节数
+ * @return uint32_t 写入的字节数
+ */
+uint32_t ring_write(ring_t *ring, const void *src, uint32_t len)
+{
+    uint32_t space = ring_space(ring);
+    if (len > space)
+        len = space;
+    ring_copy_in(ring, ring->head, src, len);
+    ring->head += len;
+    return len;
+}
+
+/**
+ * @brief 把数据写到已有数据之后offset字节处，不改变已有数据的长度，之后用ring_commit使其生效
+ *        用于先到达的乱序数据
+ *
+ * @param ring 环
+ * @param offset 相对已有数据结尾的偏移
+ * @param src 数据
+ * @param len 字节数，offset + len不能超过空闲空间
+ */
+void ring_write_at(ring_t *ring, uint32_t offset, const void *src, uint32_t len)
+{
+    assert(offset + len <= ring_space(ring));
+    ring_copy_in(ring, ring->head + offset, src, len);
+}
+
+/**
+ * @brief 把已经用ring_write_at写好的len字节计入已有数据
+ *
+ * @param ring 环
+ * @param len 字节数
+ */
+void ring_commit(ring_t *ring, uint32_t len)
+{
+    assert(len <= ring_space(ring));
+    ring->head += len;
+}
+
+/**
+ * @brief 从已有数据的offset字节处拷贝len字节，不移除数据
+ *
+ * @param ring 环
+ * @param offset 相对已有数据开头的偏移
+ * @param dst 目的地址
+ * @param len 字节数，offset + len不能超过已有数据的长度
+ */
+void ring_peek(const ring_t *ring, uint32_t offset, void *dst, uint32_t len)
+{
+    assert(offset + len <= ring_len(ring));
+    uint32_t index = (ring->tail + offset) & (ring->size - 1);
+    uint32_t first = ring->size - index < len ? ring->size - index : len;
+    memcpy(dst, ring->data + index, first);
+    memcpy((uint8_t *)dst + first, ring->data, len - first);
+}
+
+/**
+ * @brief 从开头移除len字节数据
+ *
+ * @param ring 环
+ * @param len 字节数，不超过已有数据的长度
+ */
+void ring_consume(ring_t *ring, uint32_t len)
+{
+    assert(len <= ring_len(ring));
+    ring->tail += len;
+}
+
+/**
+ * @brief 从开头读出最多len字节数据并移除
+ *
+ * @param ring 环
+ * @param dst 目的地址
+ * @param len 最多读出的字节数
+ * @return uint32_t 读出的字节数
+ */
+uint32_t ring_read(ring_t *ring, void *dst, uint32_t len)
+{
+    uint32_t size = ring_len(ring);
+    if (len > size)
+        len = size;
+    ring_peek(ring, 0, dst, len);
+    ring->tail += len;
+    return len;
+}
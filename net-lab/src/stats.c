@@ -0,0 +1,198 @@
+#include "stats.h"
+#include "net.h"
+#include "udp.h"
+
+/**
+ * @brief 各核的计数器
+ *
+ */
+stats_core_t stats_cores[STATS_CORE_NUM];
+
+/**
+ * @brief 当前线程使用的计数器行
+ *
+ */
+_Thread_local uint8_t stats_core;
+
+/**
+ * @brief 计数器名字表，导出时使用
+ *
+ */
+static const char *stats_names[STATS_NUM] = {
+    [STATS_ETH_RX] = "eth.rx",
+    [STATS_ETH_TX] = "eth.tx",
+    [STATS_ETH_DROP_SHORT] = "eth.drop.short",
+    [STATS_ETH_DROP_MTU] = "eth.drop.mtu",
+    [STATS_ETH_DROP_VLAN] = "eth.drop.vlan",
+    [STATS_ETH_DROP_PROTOCOL] = "eth.drop.protocol",
+    [STATS_ETH_TX_ERROR] = "eth.tx.error",
+
+    [STATS_ARP_RX] = "arp.rx",
+    [STATS_ARP_TX] = "arp.tx",
+    [STATS_ARP_DROP_SHORT] = "arp.drop.short",
+    [STATS_ARP_DROP_HEADER] = "arp.drop.header",
+
+    [STATS_IP_RX] = "ip.rx",
+    [STATS_IP_TX] = "ip.tx",
+    [STATS_IP_DROP_SHORT] = "ip.drop.short",
+    [STATS_IP_DROP_HEADER] = "ip.drop.header",
+    [STATS_IP_DROP_CHECKSUM] = "ip.drop.checksum",
+    [STATS_IP_DROP_DST] = "ip.drop.dst",
+    [STATS_IP_DROP_PROTOCOL] = "ip.drop.protocol",
+
+    [STATS_ICMP_RX] = "icmp.rx",
+    [STATS_ICMP_TX] = "icmp.tx",
+    [STATS_ICMP_DROP_SHORT] = "icmp.drop.short",
+
+    [STATS_IPV6_RX] = "ipv6.rx",
+    [STATS_IPV6_TX] = "ipv6.tx",
+    [STATS_IPV6_DROP_HEADER] = "ipv6.drop.header",
+    [STATS_IPV6_DROP_DST] = "ipv6.drop.dst",
+    [STATS_IPV6_DROP_FRAGMENT] = "ipv6.drop.fragment",
+    [STATS_IPV6_DROP_PROTOCOL] = "ipv6.drop.protocol",
+
+    [STATS_ICMPV6_RX] = "icmpv6.rx",
+    [STATS_ICMPV6_TX] = "icmpv6.tx",
+    [STATS_ICMPV6_DROP_SHORT] = "icmpv6.drop.short",
+    [STATS_ICMPV6_DROP_CHECKSUM] = "icmpv6.drop.checksum",
+
+    [STATS_UDP_RX] = "udp.rx",
+    [STATS_UDP_TX] = "udp.tx",
+    [STATS_UDP_DROP_SHORT] = "udp.drop.short",
+    [STATS_UDP_DROP_CHECKSUM] = "udp.drop.checksum",
+    [STATS_UDP_DROP_PORT] = "udp.drop.port",
+    [STATS_UDP_DROP_QUEUE] = "udp.drop.queue",
+
+    [STATS_TCP_RX] = "tcp.rx",
+    [STATS_TCP_TX] = "tcp.tx",
+    [STATS_TCP_DROP_SHORT] = "tcp.drop.short",
+    [STATS_TCP_DROP_CHECKSUM] = "tcp.drop.checksum",
+    [STATS_TCP_DROP_PORT] = "tcp.drop.port",
+    [STATS_TCP_DROP_MULTICAST] = "tcp.drop.multicast",
+    [STATS_TCP_RESET] = "tcp.reset",
+    [STATS_TCP_RX_OOO] = "tcp.rx.ooo",
+    [STATS_TCP_DROP_OOO] = "tcp.drop.ooo",
+    [STATS_TCP_SYN_TIMEOUT] = "tcp.syn.timeout",
+    [STATS_TCP_SYN_COOKIE] = "tcp.syn.cookie",
+    [STATS_TCP_SYN_COOKIE_OK] = "tcp.syn.cookie_ok",
+    [STATS_TCP_SYN_COOKIE_BAD] = "tcp.syn.cookie_bad",
+    [STATS_TCP_ACCEPT_OVERFLOW] = "tcp.accept.overflow",
+    [STATS_TCP_TIME_WAIT] = "tcp.time_wait",
+    [STATS_TCP_TW_REUSE] = "tcp.time_wait.reuse",
+    [STATS_TCP_TW_OVERFLOW] = "tcp.time_wait.overflow",
+    [STATS_TCP_KEEPALIVE_PROBE] = "tcp.keepalive.probe",
+    [STATS_TCP_KEEPALIVE_TIMEOUT] = "tcp.keepalive.timeout",
+    [STATS_TCP_FIN_WAIT2_TIMEOUT] = "tcp.fin_wait2.timeout",
+
+    [STATS_EVENT_OVERFLOW] = "event.overflow",
+};
+
+/**
+ * @brief 设置当前线程使用的计数器行
+ *
+ * @param core 核编号，超出STATS_CORE_NUM时取模
+ */
+void stats_set_core(uint8_t core)
+{
+    stats_core = core % STATS_CORE_NUM;
+}
+
+/**
+ * @brief 汇总各核计数器得到一份快照
+ *
+ * @param counters 出口参数，各计数器的总和
+ */
+void stats_snapshot(uint64_t counters[STATS_NUM])
+{
+    for (int i = 0; i < STATS_NUM; i++)
+    {
+        counters[i] = 0;
+        for (int core = 0; core < STATS_CORE_NUM; core++)
+            counters[i] += atomic_load_explicit(&stats_cores[core].counters[i], memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief 取计数器的名字
+ *
+ * @param counter 计数器
+ * @return const char* 名字
+ */
+const char *stats_name(stats_counter_t counter)
+{
+    return counter < STATS_NUM ? stats_names[counter] : "unknown";
+}
+
+/**
+ * @brief 把非零计数器格式化为"名字 值"的文本，每行一个
+ *
+ * @param buf 输出缓冲区
+ * @param size 缓冲区大小
+ * @return size_t 写入的长度，不含结尾的'\0'
+ */
+size_t stats_format(char *buf, size_t size)
+{
+    uint64_t counters[STATS_NUM];
+    stats_snapshot(counters);
+    size_t len = 0;
+    if (size)
+        buf[0] = '\0';
+    for (int i = 0; i < STATS_NUM; i++)
+    {
+        if (!counters[i])
+            continue;
+        int n = snprintf(buf + len, size - len, "%s %llu\n", stats_names[i], (unsigned long long)counters[i]);
+        if (n < 0 || (size_t)n >= size - len)
+        {
+            buf[len] = '\0'; //放不下的行整行丢弃
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
+
+/**
+ * @brief 打印全部非零计数器
+ *
+ * @param fp 输出文件
+ */
+void stats_dump(FILE *fp)
+{
+    char buf[STATS_TEXT_MAX_LEN];
+    stats_format(buf, sizeof(buf));
+    fprintf(fp, "===STATS BEGIN===\n%s===STATS  END ===\n", buf);
+}
+
+#ifdef UDP
+static uint16_t stats_port;                 //统计端口号
+static uint8_t stats_allow_ip[NET_IP_LEN]; //允许查询的源地址
+
+/**
+ * @brief 统计端口的处理程序，只回复允许的源地址，回复不比请求长，
+ *        伪造源地址的请求不能借它放大流量；查询方按需要的长度填充请求，放不下的计数器不回复
+ *
+ */
+static void stats_handler(uint8_t *data, size_t len, uint8_t *src_ip, uint16_t src_port)
+{
+    if (src_ip[0] != 127 && memcmp(src_ip, stats_allow_ip, NET_IP_LEN) != 0)
+        return;
+    char buf[STATS_TEXT_MAX_LEN];
+    size_t text_len = stats_format(buf, len < sizeof(buf) ? len + 1 : sizeof(buf)); //加1放结尾的'\0'
+    udp_send((uint8_t *)buf, text_len, stats_port, src_ip, src_port);
+}
+
+/**
+ * @brief 在udp端口上提供计数器查询
+ *
+ * @param port 端口号
+ * @param allow_ip 除127.0.0.0/8外唯一允许查询的源地址
+ * @return int 成功为0
+ */
+int stats_open(uint16_t port, const uint8_t *allow_ip)
+{
+    stats_port = port;
+    memcpy(stats_allow_ip, allow_ip, NET_IP_LEN);
+    return udp_open(port, stats_handler);
+}
+#endif
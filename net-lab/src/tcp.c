@@ -1,293 +1,2095 @@
 #include <assert.h>
 #include "map.h"
 #include "tcp.h"
+#include "tcp_hash.h"
 #include "ip.h"
+#include "ipv6.h"
+#include "log.h"
+#include "stats.h"
+#include "latency.h"
 
 static void panic(const char* msg, int line) {
     printf("panic %s! at line %d\n", msg, line);
     assert(0);
 }
 
-static void display_flags(tcp_flags_t flags) {
-    printf("flags:%s%s%s%s%s%s%s%s\n",
-        flags.cwr ? " cwr" : "",
-        flags.ece ? " ece" : "",
-        flags.urg ? " urg" : "",
-        flags.ack ? " ack" : "",
-        flags.psh ? " psh" : "",
-        flags.rst ? " rst" : "",
-        flags.syn ? " syn" : "",
-        flags.fin ? " fin" : ""
-    );
+// dst-port -> tcp_listener_t
+static map_t tcp_table; //tcp_table里面放了每个监听端口的回调函数与半连接计数
+
+// tcp_key_t[IP, local IP, src port, dst port, version] -> tcp_connect_t*
+
+/* Connect_table放置了所有TCP连接，按完整四元组即tcp_key_t索引，
+    连接单独分配，表中只保存指针和预先算好的哈希值，查找是O(1)的。
+    被动打开的连接还挂在监听端口的链表上，tcp_close不必遍历整张表。
+*/
+static tcp_hash_t connect_table;
+
+/**
+ * @brief 连接表哈希函数的密钥，tcp_init时从操作系统取随机数，防止对端构造冲突的四元组
+ *
+ */
+static uint8_t hash_secret[16];
+
+/**
+ * @brief 半连接：回复了SYN+ACK但还没有完成三次握手，只保存重建连接所需的状态，握手完成后才建立连接并分配收发缓存
+ *
+ */
+typedef struct tcp_syn {
+    tcp_key_t key;       // 在syn_table中的键，定时器到期时用来删除自己
+    uint32_t hash;       // key的哈希值
+    uint32_t iss, irs;   // 本端与对端的初始序号
+    uint32_t remote_win; // 对端SYN中的窗口
+    tcp_opts_t opts;     // 对端SYN中的选项
+    uint16_t vlan;
+    uint8_t retries;     // SYN+ACK重传次数
+    uint32_t rto;
+    uint64_t sent;       // 第一次发送SYN+ACK的时间，没有重传时用于测量往返时间
+    net_timer_t timer;   // SYN+ACK重传定时器
+    struct tcp_syn* next;   // 同一监听端口上的下一个半连接
+    struct tcp_syn** pprev; // 指向链表中指向自己的指针
+} tcp_syn_t;
+
+// tcp_key_t -> tcp_syn_t*，半连接单独分配，与connect_table一样按哈希查找，SYN洪泛时每个SYN仍是O(1)的
+static tcp_hash_t syn_table;
+
+/**
+ * @brief TIME_WAIT记录：主动关闭的连接释放后只保留重发最后的ACK和判断新SYN所需的状态，不保留收发缓存
+ *
+ */
+typedef struct tcp_tw {
+    tcp_key_t key;         // 在tw_table中的键，与原来的连接相同
+    uint32_t hash;         // key的哈希值，与原来的连接相同
+    uint32_t snd_nxt;      // 我方FIN之后的序号
+    uint32_t rcv_nxt;      // 对端FIN之后的序号
+    uint32_t ts_recent;    // 最近收到的对端时间戳
+    uint16_t vlan;
+    uint8_t ts_ok;         // 双方都使用时间戳
+    struct tcp_tw* next;   // 同一时间轮槽中的下一个记录
+    struct tcp_tw** pprev; // 指向链表中指向自己的指针
+} tcp_tw_t;
+
+// tcp_key_t -> tcp_tw_t*，已建立的连接与TIME_WAIT分表存放，查找已建立的连接时不会探测到TIME_WAIT记录
+static tcp_hash_t tw_table;
+
+/**
+ * @brief 回收TIME_WAIT记录的时间轮，每个槽跨TCP_TIME_WAIT_MS / TCP_TW_SLOTS毫秒。
+ *        所有记录的持续时间相同，整个时间轮只用一个协议栈定时器，每次到期回收一整个槽
+ *
+ */
+static tcp_tw_t* tw_wheel[TCP_TW_SLOTS];
+static uint32_t tw_slot; // 下一次到期时回收的槽
+static net_timer_t tw_timer;
+
+/**
+ * @brief SYN cookie的密钥，tcp_init时从操作系统取随机数
+ *
+ */
+static uint8_t syn_secret[16];
+
+/**
+ * @brief 本批收包中需要确认的连接，批末由tcp_flush_acks统一发出ACK，每个连接最多一个
+ *
+ */
+static tcp_connect_t* ack_batch[NET_RX_BATCH];
+static uint32_t ack_batch_num;
+
+/**
+ * @brief 已经关闭、没有应用层持有的连接，批末由tcp_flush_acks释放
+ *
+ */
+static tcp_connect_t* reap_list;
+
+/**
+ * @brief 下一个尝试分配的临时端口，取模后落在[TCP_EPHEMERAL_MIN, TCP_EPHEMERAL_MAX]
+ *
+ */
+static uint32_t ephemeral_next;
+
+/**
+ * @brief 生成一个用于 connect_table 的 key
+ *
+ * @param ip 对端地址
+ * @param local_ip 本端地址
+ * @param version
+ * @param src_port 对端端口
+ * @param dst_port 本端端口
+ * @return tcp_key_t
+ */
+static tcp_key_t new_tcp_key(uint8_t* ip, uint8_t* local_ip, uint8_t version, uint16_t src_port, uint16_t dst_port) {
+    tcp_key_t key;
+    memset(&key, 0, sizeof(key)); // 键按字节比较，填充字节也要清零
+    memcpy(key.ip, ip, version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN);
+    memcpy(key.local_ip, local_ip, version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN);
+    key.src_port = src_port;
+    key.dst_port = dst_port;
+    key.version = version;
+    return key;
+}
+
+/**
+ * @brief 连接表中使用的键的哈希值，用SipHash在hash_secret下计算
+ *
+ * @param key
+ * @return uint32_t
+ */
+static inline uint32_t tcp_key_hash(const tcp_key_t* key) {
+    return (uint32_t)siphash24(hash_secret, key, sizeof(tcp_key_t));
+}
+
+static void tcp_tw_timeout(void* arg);
+static void tcp_syn_drop(tcp_syn_t* syn);
+static void release_tcp_connect(tcp_connect_t* connect);
+
+/**
+ * @brief 初始化tcp在静态区的map
+ *        供应用层使用
+ *
+ */
+void tcp_init() {
+    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_listener_t), 0, 0, NULL);
+    tcp_hash_init(&connect_table, TCP_HASH_INIT_SIZE, offsetof(tcp_connect_t, key), sizeof(tcp_key_t));
+    tcp_hash_init(&syn_table, TCP_HASH_INIT_SIZE, offsetof(tcp_syn_t, key), sizeof(tcp_key_t));
+    tcp_hash_init(&tw_table, TCP_HASH_INIT_SIZE, offsetof(tcp_tw_t, key), sizeof(tcp_key_t));
+    timer_setup(&tw_timer, tcp_tw_timeout, NULL);
+    unsigned int seed;
+    if (random_bytes(syn_secret, sizeof(syn_secret)) != 0 || random_bytes(hash_secret, sizeof(hash_secret)) != 0
+        || random_bytes(&seed, sizeof(seed)) != 0) {
+        // 取不到系统随机数时退回时间，密钥可以被猜到
+        fprintf(stderr, "tcp: no system randomness, secrets are predictable\n");
+        srand(time(NULL) ^ (uint32_t)timer_now());
+        for (size_t i = 0; i < sizeof(syn_secret); i++) {
+            syn_secret[i] = rand();
+            hash_secret[i] = rand();
+        }
+    } else {
+        srand(seed); // 初始序号仍由rand()生成
+    }
+    ephemeral_next = time(NULL); // 起点随机，避免重启后马上复用上次的端口
+    net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
+    net_add_protocol(NET_IPV6_UPPER(NET_PROTOCOL_TCP), tcp6_in);
+}
+
+/**
+ * @brief 注册或更新 port 上的监听端口
+ *        已注册的端口原地更新回调函数和队列容量，已有连接、半连接、全连接队列和就绪事件的注册都保留；
+ *        改为不带队列时，队列中还没有取出的连接应用层无从得知，与tcp_close一样释放
+ *
+ * @param port
+ * @param handler
+ * @param backlog 全连接队列容量，0表示不带队列
+ * @return tcp_listener_t* 监听端口，失败为NULL
+ */
+static tcp_listener_t* tcp_listener_set(uint16_t port, tcp_handler_t handler, uint32_t backlog) {
+    tcp_listener_t* listener = map_get(&tcp_table, &port);
+    if (listener == NULL) {
+        tcp_listener_t new_listener = {
+            .handler = handler,
+            .backlog = backlog,
+        };
+        if (map_set(&tcp_table, &port, &new_listener) != 0)
+            return NULL;
+        return map_get(&tcp_table, &port);
+    }
+    if (!backlog) {
+        while (listener->accept_tail != listener->accept_head)
+            release_tcp_connect(listener->accept_queue[listener->accept_tail % TCP_ACCEPT_BACKLOG_MAX]);
+    }
+    listener->handler = handler;
+    listener->backlog = backlog; // 队列中超出新容量的连接保留，取出后才接收新的连接
+    return listener;
+}
+
+/**
+ * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
+ *        供应用层使用
+ *
+ * @param port
+ * @param handler
+ * @return int
+ */
+int tcp_open(uint16_t port, tcp_handler_t handler) {
+    printf("tcp open\n");
+    return tcp_listener_set(port, handler, 0) != NULL ? 0 : -1;
+}
+
+/**
+ * @brief 在 port 上创建带全连接队列的监听端口，建立的连接放入队列，由tcp_accept成批取出，
+ *        不再以TCP_CONN_CONNECTED回调；队列满时丢弃第三次握手，等对端重传
+ *        供应用层使用
+ *
+ * @param port
+ * @param backlog 全连接队列容量，不超过TCP_ACCEPT_BACKLOG_MAX，0取上限
+ * @param handler 连接收到数据和关闭时的回调函数，只使用就绪事件时为NULL
+ * @return tcp_listener_t* 监听端口，tcp_close之前一直有效，失败为NULL
+ */
+tcp_listener_t* tcp_listen(uint16_t port, uint32_t backlog, tcp_handler_t handler) {
+    return tcp_listener_set(port, handler, backlog && backlog < TCP_ACCEPT_BACKLOG_MAX ? backlog : TCP_ACCEPT_BACKLOG_MAX);
+}
+
+/**
+ * @brief 从全连接队列中取出最多max个已建立的连接，取出的句柄归应用层所有，
+ *        连接被对端复位后仍然有效（状态为TCP_CLOSED），用完后调用tcp_connect_close释放
+ *        供应用层使用
+ *
+ * @param listener tcp_listen返回的监听端口
+ * @param connects 取出的连接
+ * @param max 最多取出的个数
+ * @return size_t 取出的个数
+ */
+size_t tcp_accept(tcp_listener_t* listener, tcp_connect_t** connects, size_t max) {
+    size_t n = 0;
+    while (n < max && listener->accept_tail != listener->accept_head) {
+        tcp_connect_t* connect = listener->accept_queue[listener->accept_tail++ % TCP_ACCEPT_BACKLOG_MAX];
+        connect->accepting = 0;
+        connect->owned = 1;
+        connects[n++] = connect;
+    }
+    return n;
+}
+
+/**
+ * @brief 关注监听端口的就绪事件，全连接队列中有新连接时可读，由event_get取出
+ *        供应用层使用
+ *
+ * @param listener tcp_listen返回的监听端口
+ * @param interest 关注的事件，0表示取消
+ * @param data 用户数据，随事件返回
+ */
+void tcp_listen_watch(tcp_listener_t* listener, uint8_t interest, void* data) {
+    event_watch(&listener->event, interest, data, listener->accept_tail != listener->accept_head ? EVENT_READABLE : 0);
+}
+
+/**
+ * @brief 把还没有被tcp_accept取出的连接从全连接队列中移除
+ *
+ * @param connect
+ */
+static void tcp_accept_remove(tcp_connect_t* connect) {
+    tcp_listener_t* listener = map_get(&tcp_table, &connect->local_port);
+    connect->accepting = 0;
+    if (listener == NULL)
+        return;
+    uint32_t head = listener->accept_tail;
+    for (uint32_t i = listener->accept_tail; i != listener->accept_head; i++) {
+        tcp_connect_t* queued = listener->accept_queue[i % TCP_ACCEPT_BACKLOG_MAX];
+        if (queued != connect)
+            listener->accept_queue[head++ % TCP_ACCEPT_BACKLOG_MAX] = queued;
+    }
+    listener->accept_head = head;
+}
+
+static void tcp_rtx_timeout(void* arg);
+static void tcp_delack_timeout(void* arg);
+static void tcp_keepalive_timeout(void* arg);
+static void tcp_notify_closed(tcp_connect_t* connect);
+
+/**
+ * @brief 完成了缓存分配工作，状态也会切换为TCP_SYN_RCVD
+ *        rx_buf和tx_buf是环形缓冲区，回绕时不需要搬移数据。
+ *
+ * @param connect
+ * @return int 成功为0，分配缓存失败为-1，已分配的缓存释放，连接状态不变
+ */
+static int init_tcp_connect_rcvd(tcp_connect_t* connect) {
+    if (connect->state == TCP_LISTEN) {
+        if (ring_init(&connect->rx_buf, TCP_RCV_BUF_SIZE) != 0)
+            return -1;
+        if (ring_init(&connect->tx_buf, TCP_SND_BUF_SIZE) != 0) {
+            ring_free(&connect->rx_buf);
+            return -1;
+        }
+    }
+    ring_reset(&connect->rx_buf);
+    ring_reset(&connect->tx_buf);
+    timer_setup(&connect->rtx_timer, tcp_rtx_timeout, connect);
+    timer_setup(&connect->delack_timer, tcp_delack_timeout, connect);
+    timer_setup(&connect->ka_timer, tcp_keepalive_timeout, connect);
+    connect->rto = TCP_RTO_INIT_MS;
+    connect->srtt = connect->rttvar = 0;
+    connect->rtt_start = 0;
+    connect->retries = 0;
+    connect->fin_acked = 0;
+    connect->ooo_num = 0;
+    connect->accepting = 0;
+    connect->rcv_mss = TCP_DEFAULT_MSS;
+    connect->ack_now = 0;
+    connect->nodelay = 0; // 默认使用Nagle算法
+    connect->cork = 0;
+    connect->owned = 0;
+    connect->user_closed = 0;
+    connect->rx_stamp = timer_now();
+    connect->ka_idle = TCP_KEEPALIVE_IDLE_MS;
+    connect->ka_intvl = TCP_KEEPALIVE_INTVL_MS;
+    connect->ka_probes = TCP_KEEPALIVE_PROBES;
+    connect->ka_sent = 0;
+    if (connect->ka_idle)
+        timer_add(&connect->ka_timer, connect->ka_idle);
+    connect->state = TCP_SYN_RCVD;
+    return 0;
+}
+
+/**
+ * @brief 把连接从本批的待确认表中移除
+ *
+ * @param connect
+ */
+static void tcp_ack_batch_remove(tcp_connect_t* connect) {
+    connect->ack_now = 0;
+    for (uint32_t i = 0; i < ack_batch_num; i++) {
+        if (ack_batch[i] == connect) {
+            ack_batch[i] = ack_batch[--ack_batch_num];
+            return;
+        }
+    }
+}
+
+/**
+ * @brief 分配一个连接并放入连接表，状态为TCP_LISTEN，还没有分配缓存
+ *
+ * @param key 连接的键
+ * @param listener 被动打开的连接所在的监听端口，主动打开为NULL
+ * @return tcp_connect_t* 新的连接，失败为NULL
+ */
+static tcp_connect_t* tcp_connect_new(const tcp_key_t* key, tcp_listener_t* listener) {
+    tcp_connect_t* connect = malloc(sizeof(tcp_connect_t));
+    if (connect == NULL)
+        return NULL;
+    *connect = CONNECT_LISTEN;
+    memcpy(&connect->key, key, sizeof(tcp_key_t)); // 连同填充字节一起复制，表按字节比较键
+    connect->hash = tcp_key_hash(key);
+    connect->cc = tcp_cc_get(TCP_CC_DEFAULT); // 窗口在握手完成时由tcp_cc_reset初始化
+    if (tcp_hash_add(&connect_table, connect, connect->hash) != 0) {
+        free(connect);
+        return NULL;
+    }
+    if (listener != NULL) {
+        connect->port_next = listener->connects;
+        if (connect->port_next)
+            connect->port_next->port_pprev = &connect->port_next;
+        connect->port_pprev = &listener->connects;
+        listener->connects = connect;
+    }
+    return connect;
+}
+
+/**
+ * @brief 把连接从连接表和监听端口的连接链表中摘下
+ *
+ * @param connect
+ */
+static void tcp_connect_unlink(tcp_connect_t* connect) {
+    tcp_hash_remove(&connect_table, connect, connect->hash);
+    if (connect->port_pprev) {
+        *connect->port_pprev = connect->port_next;
+        if (connect->port_next)
+            connect->port_next->port_pprev = connect->port_pprev;
+        connect->port_pprev = NULL;
+    }
+}
+
+/**
+ * @brief 释放连接对象。推迟到本批收包处理完后由tcp_flush_acks释放，
+ *        这样协议栈和handler在处理这一批报文段时仍可以访问它
+ *
+ * @param connect
+ */
+static void tcp_connect_free(tcp_connect_t* connect) {
+    connect->reap_next = reap_list;
+    reap_list = connect;
+}
+
+/**
+ * @brief 关闭TCP连接：停止定时器，从连接表和监听端口的链表中移除，释放缓存，状态变为TCP_CLOSED。
+ *        应用层持有句柄时对象保留到tcp_connect_close，否则随后释放。
+ *        栈上状态为TCP_LISTEN的连接不在连接表中，已经关闭的连接也不用再关闭，什么也不做
+ *
+ * @param connect
+ */
+static void release_tcp_connect(tcp_connect_t* connect) {
+    if (connect->state == TCP_LISTEN || connect->state == TCP_CLOSED)
+        return;
+    timer_cancel(&connect->rtx_timer);
+    timer_cancel(&connect->delack_timer);
+    timer_cancel(&connect->ka_timer);
+    if (connect->accepting)
+        tcp_accept_remove(connect);
+    if (connect->ack_now)
+        tcp_ack_batch_remove(connect);
+    event_post(&connect->event, EVENT_CLOSED);
+    event_release(&connect->event);
+    ring_free(&connect->rx_buf);
+    ring_free(&connect->tx_buf);
+    tcp_connect_unlink(connect);
+    connect->state = TCP_CLOSED;
+    if (!connect->owned)
+        tcp_connect_free(connect);
+}
+
+static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip, uint8_t version) {
+    if (version == IP_VERSION_6)
+        return ipv6_checksum(buf, src_ip, dst_ip, NET_PROTOCOL_TCP);
+    uint16_t len = (uint16_t)buf->len;
+    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
+    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
+    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
+    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
+    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
+    peso_hdr->placeholder = 0;
+    peso_hdr->protocol = NET_PROTOCOL_TCP;
+    peso_hdr->total_len16 = swap16(len);
+    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
+    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
+    return checksum;
+}
+
+/**
+ * @brief 关闭 port 上的 TCP 连接
+ *        供应用层使用
+ *
+ * @param port
+ */
+void tcp_close(uint16_t port) {
+    tcp_listener_t* listener = map_get(&tcp_table, &port);
+    if (listener != NULL) {
+        while (listener->syns != NULL)
+            tcp_syn_drop(listener->syns);
+        while (listener->connects != NULL) {
+            tcp_notify_closed(listener->connects);
+            release_tcp_connect(listener->connects);
+        }
+        event_post(&listener->event, EVENT_CLOSED);
+        event_release(&listener->event);
+    }
+    map_delete(&tcp_table, &port);
+}
+
+/**
+ * @brief 往按序号排列的区间表中加入一个序号区间，与已有区间重叠或相邻时合并
+ *        用于接收方的乱序数据区间和发送方的SACK记分板
+ *
+ * @param ranges 区间表
+ * @param num 区间数
+ * @param max 区间数上限
+ * @param start 起始序号
+ * @param end 结束序号
+ * @return int 成功为0，区间数已达上限为-1
+ */
+static int tcp_range_insert(tcp_range_t* ranges, uint8_t* num, int max, uint32_t start, uint32_t end) {
+    int i = 0, j;
+    while (i < *num && TCP_SEQ_LT(ranges[i].end, start))
+        i++;
+    for (j = i; j < *num && TCP_SEQ_LEQ(ranges[j].start, end); j++) {
+        if (TCP_SEQ_LT(ranges[j].start, start))
+            start = ranges[j].start;
+        if (TCP_SEQ_LT(end, ranges[j].end))
+            end = ranges[j].end;
+    }
+    if (i == j) {
+        if (*num == max)
+            return -1;
+        memmove(&ranges[i + 1], &ranges[i], (*num - i) * sizeof(tcp_range_t));
+        (*num)++;
+    } else {
+        memmove(&ranges[i + 1], &ranges[j], (*num - j) * sizeof(tcp_range_t));
+        *num -= j - i - 1;
+    }
+    ranges[i].start = start;
+    ranges[i].end = end;
+    return 0;
+}
+
+/**
+ * @brief 从 buf 中读取序号为seq起的数据到 connect->rx_buf
+ *        已经收到过的部分和超出接收缓存的部分被丢弃；乱序数据直接写到rx_buf中按序数据之后对应的位置并记下区间，
+ *        空缺补齐后一并成为按序数据，不需要再次拷贝
+ *
+ * @param connect
+ * @param buf
+ * @param seq 数据的起始序号
+ * @return size_t 新增的按序数据字节数
+ */
+static size_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf, uint32_t seq) {
+    ring_t* rx_buf = &connect->rx_buf;
+    uint8_t* data = buf->data;
+    uint32_t len = buf->len;
+    if (TCP_SEQ_LT(seq, connect->ack)) {
+        uint32_t dup = connect->ack - seq;
+        if (dup >= len)
+            return 0;
+        data += dup;
+        len -= dup;
+        seq = connect->ack;
+    }
+    uint32_t offset = seq - connect->ack;
+    uint32_t space = ring_space(rx_buf);
+    if (len == 0 || offset >= space)
+        return 0;
+    len = min32(len, space - offset);
+    ring_write_at(rx_buf, offset, data, len);
+    if (offset > 0) {
+        if (tcp_range_insert(connect->ooo, &connect->ooo_num, TCP_OOO_MAX, seq, seq + len) != 0) {
+            stats_inc(STATS_TCP_DROP_OOO);
+        } else {
+            stats_inc(STATS_TCP_RX_OOO);
+            connect->ooo_recent = seq;
+        }
+        return 0;
+    }
+
+    // 空缺补齐，合并紧接着的乱序数据
+    uint32_t end = seq + len;
+    while (connect->ooo_num && TCP_SEQ_LEQ(connect->ooo[0].start, end)) {
+        if (TCP_SEQ_LT(end, connect->ooo[0].end))
+            end = connect->ooo[0].end;
+        memmove(&connect->ooo[0], &connect->ooo[1], (connect->ooo_num - 1) * sizeof(tcp_range_t));
+        connect->ooo_num--;
+    }
+    len = end - connect->ack;
+    ring_commit(rx_buf, len); // 数据已经在位置上
+    connect->ack = end;
+    return len;
+}
+
+/**
+ * @brief 本端发出的非SYN报文段中SACK区间的个数
+ *
+ * @param connect
+ * @return int 区间数
+ */
+static int tcp_sack_blocks(tcp_connect_t* connect) {
+    if (!connect->sack_ok)
+        return 0;
+    int max = connect->ts_ok ? TCP_SACK_BLOCK_MAX - 1 : TCP_SACK_BLOCK_MAX; // 选项总长不超过40字节
+    return connect->ooo_num < max ? connect->ooo_num : max;
+}
+
+/**
+ * @brief 本端发出的非SYN报文段的选项长度
+ *
+ * @param connect
+ * @return uint16_t 字节数，4的倍数
+ */
+static uint16_t tcp_opt_len(tcp_connect_t* connect) {
+    int blocks = tcp_sack_blocks(connect);
+    return (connect->ts_ok ? TCP_OPT_TS_ALIGNED_LEN : 0) + (blocks ? 4 + blocks * sizeof(tcp_range_t) : 0);
+}
+
+/**
+ * @brief 计算连接的有效MSS，不超过对端通告的MSS，并按路径MTU钳制，再扣除选项占用的长度。
+ *        路径MTU算出的上限缓存在连接上，只在网卡MTU或路径MTU变化后重新查询
+ *
+ * @param connect
+ * @return uint16_t 单个报文段的最大负载
+ */
+uint16_t tcp_mss(tcp_connect_t* connect) {
+    if (!connect->path_mss || connect->path_mss_gen != net_pmtu_gen) {
+        connect->path_mss = connect->version == IP_VERSION_6
+                                ? ipv6_pmtu_get(connect->ip) - sizeof(ipv6_hdr_t) - sizeof(tcp_hdr_t)
+                                : ip_pmtu_get(connect->ip) - sizeof(ip_hdr_t) - sizeof(tcp_hdr_t);
+        connect->path_mss_gen = net_pmtu_gen;
+    }
+    uint16_t mss = connect->path_mss;
+    if (connect->remote_mss && connect->remote_mss < mss)
+        mss = connect->remote_mss;
+    return mss - tcp_opt_len(connect);
+}
+
+/**
+ * @brief 判断是否推迟发送tx_buf末尾不足MSS的数据，等后面的写入凑成更大的报文段：
+ *        cork时一直等到凑够MSS或取消cork；否则按Nagle算法（Minshall改进，RFC 896），
+ *        之前发出的小报文段还没有被确认时等待，NODELAY时不等。正在关闭时剩余的数据立即发出
+ *
+ * @param connect
+ * @param sent 已发出未确认的字节数
+ * @return int 推迟为1，立即发送为0
+ */
+static int tcp_nagle_hold(tcp_connect_t* connect, uint32_t sent) {
+    if (connect->state != TCP_ESTABLISHED)
+        return 0;
+    if (connect->cork)
+        return 1;
+    return !connect->nodelay && sent && TCP_SEQ_LT(connect->unack_seq, connect->snd_sml);
+}
+
+/**
+ * @brief 把connect内tx_buf中尚未发送的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ *        不超过对端窗口、拥塞窗口和MSS；对端窗口为0且没有在途数据时，允许写1字节用于探测窗口。
+ *        末尾不足MSS的数据可能按tcp_nagle_hold推迟，写入0字节。
+ *
+ * @param connect
+ * @param buf
+ * @return uint16_t 字节数
+ */
+static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
+    uint32_t sent = connect->next_seq - connect->unack_seq;
+    uint32_t tx_len = ring_len(&connect->tx_buf);
+    uint32_t win = connect->remote_win ? min32(connect->remote_win, connect->cwnd) : (sent == 0);
+    uint16_t mss = tcp_mss(connect);
+    uint32_t size = 0;
+    if (sent < tx_len && sent < win)
+        size = min32(min32(tx_len - sent, win - sent), mss);
+    if (size && size < mss && size == tx_len - sent && tcp_nagle_hold(connect, sent))
+        size = 0;
+    buf_init(buf, size);
+    if (size)
+        ring_peek(&connect->tx_buf, sent, buf->data, size);
+    connect->next_seq += size;
+    if (size && size < mss)
+        connect->snd_sml = connect->next_seq;
+#ifdef LATENCY
+    if (size && connect->tx_stamp) {
+        latency_record(LATENCY_STAGE_TX_WAIT, latency_now() - connect->tx_stamp);
+        if (connect->next_seq - connect->unack_seq >= ring_len(&connect->tx_buf))
+            connect->tx_stamp = 0;
+    }
+#endif
+    return size;
+}
+
+/**
+ * @brief 判断tx_buf的数据发完后是否还要发送FIN：处于关闭状态且FIN还没有发出或需要重传
+ *
+ * @param connect
+ * @return int 是为1，否为0
+ */
+static int tcp_fin_pending(tcp_connect_t* connect) {
+    return (connect->state == TCP_FIN_WAIT_1 || connect->state == TCP_CLOSING || connect->state == TCP_LAST_ACK) &&
+           !connect->fin_acked && connect->next_seq - connect->unack_seq == ring_len(&connect->tx_buf);
+}
+
+/**
+ * @brief 本端通告的MSS，网卡MTU减去IP和TCP头部
+ *
+ * @param version
+ * @return uint16_t MSS
+ */
+static uint16_t tcp_local_mss(uint8_t version) {
+    return net_if_mtu - (version == IP_VERSION_6 ? sizeof(ipv6_hdr_t) : sizeof(ip_hdr_t)) - sizeof(tcp_hdr_t);
+}
+
+/**
+ * @brief 解析报文段中的TCP选项，格式不对的选项及其后的选项被忽略
+ *
+ * @param opts 解析结果
+ * @param hdr tcp头部
+ * @param hdr_len 头部长度，含选项
+ */
+static void tcp_parse_options(tcp_opts_t* opts, tcp_hdr_t* hdr, size_t hdr_len) {
+    memset(opts, 0, sizeof(tcp_opts_t));
+    uint8_t* opt = (uint8_t*)(hdr + 1);
+    uint8_t* end = (uint8_t*)hdr + hdr_len;
+    while (opt < end && *opt != TCP_OPT_END) {
+        if (*opt == TCP_OPT_NOP) {
+            opt++;
+            continue;
+        }
+        if (opt + 2 > end || opt[1] < 2 || opt + opt[1] > end)
+            break;
+        switch (opt[0]) {
+        case TCP_OPT_MSS:
+            if (opt[1] == TCP_OPT_MSS_LEN)
+                opts->mss = (opt[2] << 8) | opt[3];
+            break;
+        case TCP_OPT_WSCALE:
+            if (opt[1] == TCP_OPT_WSCALE_LEN) {
+                opts->wscale_ok = 1;
+                opts->wscale = opt[2] > TCP_WSCALE_MAX ? TCP_WSCALE_MAX : opt[2];
+            }
+            break;
+        case TCP_OPT_SACK_PERM:
+            if (opt[1] == TCP_OPT_SACK_PERM_LEN)
+                opts->sack_ok = 1;
+            break;
+        case TCP_OPT_SACK:
+            for (int i = 2; i + sizeof(tcp_range_t) <= opt[1] && opts->sack_num < TCP_SACK_BLOCK_MAX; i += sizeof(tcp_range_t)) {
+                tcp_range_t* range = &opts->sack[opts->sack_num++];
+                memcpy(range, opt + i, sizeof(tcp_range_t));
+                range->start = swap32(range->start);
+                range->end = swap32(range->end);
+            }
+            break;
+        case TCP_OPT_TS:
+            if (opt[1] == TCP_OPT_TS_LEN) {
+                opts->ts_ok = 1;
+                memcpy(&opts->tsval, opt + 2, sizeof(uint32_t));
+                memcpy(&opts->tsecr, opt + 6, sizeof(uint32_t));
+                opts->tsval = swap32(opts->tsval);
+                opts->tsecr = swap32(opts->tsecr);
+            }
+            break;
+        default:
+            break;
+        }
+        opt += opt[1];
+    }
+}
+
+/**
+ * @brief 本端通告窗口的扩大因子：让整个接收缓存能放进16位窗口字段的最小移位
+ *
+ * @return uint8_t 移位数
+ */
+static uint8_t tcp_rcv_wscale() {
+    uint8_t wscale = 0;
+    while (wscale < TCP_WSCALE_MAX && (TCP_RCV_BUF_SIZE >> wscale) > UINT16_MAX)
+        wscale++;
+    return wscale;
+}
+
+/**
+ * @brief 根据对端SYN中的选项协商MSS、窗口扩大因子、SACK与时间戳，本端只在对端提出时才启用
+ *
+ * @param connect
+ * @param opts 对端SYN中的选项
+ */
+static void tcp_negotiate(tcp_connect_t* connect, const tcp_opts_t* opts) {
+    connect->remote_mss = opts->mss ? opts->mss : (connect->version == IP_VERSION_6 ? TCP_DEFAULT_MSS6 : TCP_DEFAULT_MSS);
+    connect->snd_wscale = connect->rcv_wscale = 0;
+    if (opts->wscale_ok) {
+        connect->snd_wscale = opts->wscale;
+        connect->rcv_wscale = tcp_rcv_wscale();
+    }
+    connect->sack_ok = opts->sack_ok;
+    connect->ts_ok = opts->ts_ok;
+    connect->ts_recent = opts->tsval;
+    connect->sacked_num = 0;
+}
+
+/**
+ * @brief 本端要通告的接收窗口，即接收缓存的空闲字节数，不超过窗口字段按rcv_wscale能表示的最大值
+ *        接收方糊涂窗口综合征避免（RFC 1122 4.2.3.3）：空闲空间比已通告的窗口多出
+ *        min(缓存的一半, MSS)以上才把右沿前移，否则维持已通告的右沿，窗口也不会向左收回
+ *
+ * @param connect
+ * @return uint32_t 字节数
+ */
+static uint32_t tcp_rcv_window(tcp_connect_t* connect) {
+    if (connect->state == TCP_LISTEN)
+        return 0;
+    uint32_t space = min32(ring_space(&connect->rx_buf), UINT16_MAX << connect->rcv_wscale);
+    uint32_t adv = TCP_SEQ_LT(connect->ack, connect->rcv_adv) ? connect->rcv_adv - connect->ack : 0;
+    uint32_t thresh = min32(TCP_RCV_BUF_SIZE / 2, tcp_local_mss(connect->version));
+    if (space >= adv + thresh)
+        return space;
+    return adv;
+}
+
+/**
+ * @brief 应用读走数据后是否需要发送窗口更新
+ *
+ * @param connect
+ * @return int 通告窗口的右沿可以前移为1，否则为0
+ */
+static int tcp_window_update_due(tcp_connect_t* connect) {
+    return TCP_SEQ_LT(connect->rcv_adv, connect->ack + tcp_rcv_window(connect));
+}
+
+/**
+ * @brief 选取本端初始序号
+ *
+ * @return uint32_t 初始序号
+ */
+static inline uint32_t tcp_iss_new() {
+#ifdef TEST
+    return TCP_TEST_ISS;
+#else
+    return rand();
+#endif
+}
+
+/**
+ * @brief 时间戳选项的取值，毫秒
+ *
+ * @return uint32_t 时间戳
+ */
+static inline uint32_t tcp_ts_now() {
+    return (uint32_t)timer_now();
+}
+
+/**
+ * @brief 写入时间戳选项，前面补两个NOP对齐
+ *
+ * @param connect
+ * @param opt 选项位置
+ * @return int 写入的字节数
+ */
+static int tcp_put_ts(tcp_connect_t* connect, uint8_t* opt) {
+    uint32_t tsval = swap32(tcp_ts_now());
+    uint32_t tsecr = swap32(connect->ts_recent);
+    opt[0] = TCP_OPT_NOP;
+    opt[1] = TCP_OPT_NOP;
+    opt[2] = TCP_OPT_TS;
+    opt[3] = TCP_OPT_TS_LEN;
+    memcpy(opt + 4, &tsval, sizeof(uint32_t));
+    memcpy(opt + 8, &tsecr, sizeof(uint32_t));
+    return TCP_OPT_TS_ALIGNED_LEN;
+}
+
+/**
+ * @brief 写入SYN报文段的选项：MSS，以及对端提出过的SACK、时间戳和窗口扩大因子
+ *
+ * @param connect
+ * @param opt 选项位置，至少TCP_OPT_MAX_LEN字节
+ * @return int 写入的字节数，4的倍数
+ */
+static int tcp_syn_options(tcp_connect_t* connect, uint8_t* opt) {
+    int len = 0;
+    uint16_t mss = tcp_local_mss(connect->version);
+    opt[len++] = TCP_OPT_MSS;
+    opt[len++] = TCP_OPT_MSS_LEN;
+    opt[len++] = mss >> 8;
+    opt[len++] = mss & 0xff;
+    if (connect->ts_ok) {
+        len += tcp_put_ts(connect, opt + len);
+        if (connect->sack_ok) {
+            opt[len - TCP_OPT_TS_ALIGNED_LEN] = TCP_OPT_SACK_PERM; // 用允许SACK替换两个NOP
+            opt[len - TCP_OPT_TS_ALIGNED_LEN + 1] = TCP_OPT_SACK_PERM_LEN;
+        }
+    } else if (connect->sack_ok) {
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_SACK_PERM;
+        opt[len++] = TCP_OPT_SACK_PERM_LEN;
+    }
+    if (connect->state == TCP_SYN_SEND || connect->snd_wscale || connect->rcv_wscale) {
+        opt[len++] = TCP_OPT_NOP;
+        opt[len++] = TCP_OPT_WSCALE;
+        opt[len++] = TCP_OPT_WSCALE_LEN;
+        opt[len++] = connect->rcv_wscale;
+    }
+    return len;
+}
+
+/**
+ * @brief 写入非SYN报文段的选项：时间戳，以及有乱序数据时的SACK区间，最近收到的区间在最前
+ *
+ * @param connect
+ * @param opt 选项位置，至少TCP_OPT_MAX_LEN字节
+ * @return int 写入的字节数，等于tcp_opt_len
+ */
+static int tcp_options(tcp_connect_t* connect, uint8_t* opt) {
+    int len = 0;
+    if (connect->ts_ok)
+        len += tcp_put_ts(connect, opt);
+    int blocks = tcp_sack_blocks(connect);
+    if (blocks == 0)
+        return len;
+    opt[len++] = TCP_OPT_NOP;
+    opt[len++] = TCP_OPT_NOP;
+    opt[len++] = TCP_OPT_SACK;
+    opt[len++] = 2 + blocks * sizeof(tcp_range_t);
+    int first = 0;
+    for (int i = 0; i < connect->ooo_num; i++)
+        if (TCP_SEQ_LEQ(connect->ooo[i].start, connect->ooo_recent) && TCP_SEQ_LT(connect->ooo_recent, connect->ooo[i].end))
+            first = i;
+    for (int n = 0, i = first; n < blocks; n++, i = (i + 1) % connect->ooo_num) {
+        tcp_range_t range = {swap32(connect->ooo[i].start), swap32(connect->ooo[i].end)};
+        memcpy(opt + len, &range, sizeof(tcp_range_t));
+        len += sizeof(tcp_range_t);
+    }
+    return len;
+}
+
+/**
+ * @brief 一批报文段共用的TCP头部模板
+ *
+ */
+typedef struct tcp_tmpl {
+    tcp_hdr_t hdr;
+    uint8_t opt[TCP_OPT_MAX_LEN]; // 非SYN报文段的选项
+    uint8_t opt_len;
+    uint32_t sum;     // 伪头部与头部固定字段的校验和累加值，不含长度、序号、数据偏移、标志与窗口字段
+    uint32_t opt_sum; // 选项的校验和累加值
+    uint32_t rcv_adv; // 模板中窗口的右沿
+} tcp_tmpl_t;
+
+/**
+ * @brief 准备连接的TCP头部模板，一批报文段共用，每个报文段只需要填入序号、标志和校验和
+ *        同时计算伪头部和模板中固定字段的校验和累加值
+ *
+ * @param connect
+ * @param tmpl 头部模板
+ */
+static void tcp_hdr_prepare(tcp_connect_t* connect, tcp_tmpl_t* tmpl) {
+    tcp_hdr_t* hdr = &tmpl->hdr;
+    uint32_t win = tcp_rcv_window(connect) >> connect->rcv_wscale;
+    hdr->src_port16 = swap16(connect->local_port);
+    hdr->dst_port16 = swap16(connect->remote_port);
+    hdr->seq_number32 = 0;
+    hdr->ack_number32 = swap32(connect->ack);
+    hdr->data_offset = 0;
+    hdr->reserved = 0;
+    hdr->flags = tcp_flags_null;
+    hdr->window_size16 = 0;
+    hdr->chunksum16 = 0;
+    hdr->urgent_pointer16 = 0;
+    uint32_t sum = checksum_add(0, hdr, sizeof(tcp_hdr_t));
+    if (win > UINT16_MAX)
+        win = UINT16_MAX;
+    hdr->window_size16 = swap16(win);
+    tmpl->rcv_adv = connect->ack + (win << connect->rcv_wscale);
+    if (connect->version == IP_VERSION_6) {
+        sum = checksum_add(sum, ipv6_src_for(connect->ip), NET_IP6_LEN);
+        sum = checksum_add(sum, connect->ip, NET_IP6_LEN);
+    } else {
+        sum = checksum_add(sum, net_if_ip, NET_IP_LEN);
+        sum = checksum_add(sum, connect->ip, NET_IP_LEN);
+    }
+    tmpl->sum = sum + swap16(NET_PROTOCOL_TCP);
+    tmpl->opt_len = tcp_options(connect, tmpl->opt);
+    tmpl->opt_sum = checksum_add(0, tmpl->opt, tmpl->opt_len);
+}
+
+/**
+ * @brief 用头部模板发送TCP包, seq_number32 = connect->next_seq - buf->len
+ *        buf里的数据将作为负载，复制模板后只改写序号、标志与校验和，校验和在模板的累加值上补上变化的部分。
+ *        SYN报文段换成SYN的选项，窗口不扩大。如果flags包含syn或fin，seq会递增。
+ *        占用序号的报文段会启动重传定时器，没有重传过的新报文段用于测量往返时间。
+ *
+ * @param buf
+ * @param connect
+ * @param tmpl tcp_hdr_prepare准备的头部模板
+ * @param flags
+ */
+static void tcp_send_prepared(buf_t* buf, tcp_connect_t* connect, const tcp_tmpl_t* tmpl, tcp_flags_t flags) {
+    // printf("<< tcp send >> sz=%zu\n", buf->len);
+    LOG_DEBUG(LOG_EVENT_TCP_SEND, connect->ip, connect->version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN,
+              connect->local_port, connect->remote_port, *(uint8_t *)&flags);
+    size_t prev_len = buf->len;
+    uint32_t seq = connect->next_seq - prev_len;
+    uint32_t sum = checksum_add(tmpl->sum, buf->data, prev_len);
+    if (flags.syn) {
+        uint8_t opt[TCP_OPT_MAX_LEN];
+        int opt_len = tcp_syn_options(connect, opt);
+        buf_add_header(buf, opt_len);
+        memcpy(buf->data, opt, opt_len);
+        sum = checksum_add(sum, opt, opt_len);
+    } else if (tmpl->opt_len) {
+        buf_add_header(buf, tmpl->opt_len);
+        memcpy(buf->data, tmpl->opt, tmpl->opt_len);
+        sum += tmpl->opt_sum;
+    }
+    size_t opt_len = buf->len - prev_len;
+    buf_add_header(buf, sizeof(tcp_hdr_t));
+    tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
+    memcpy(hdr, &tmpl->hdr, sizeof(tcp_hdr_t));
+    hdr->seq_number32 = swap32(seq);
+    hdr->data_offset = (sizeof(tcp_hdr_t) + opt_len) / sizeof(uint32_t);
+    hdr->flags = flags;
+    uint32_t rcv_adv = tmpl->rcv_adv;
+    if (flags.syn) {
+        uint32_t win = tcp_rcv_window(connect); // SYN中的窗口不扩大
+        if (win > UINT16_MAX)
+            win = UINT16_MAX;
+        hdr->window_size16 = swap16(win);
+        rcv_adv = connect->ack + win;
+    }
+    sum = checksum_add(sum, &hdr->seq_number32, sizeof(hdr->seq_number32));
+    sum = checksum_add(sum, (uint8_t*)&hdr->window_size16 - sizeof(uint16_t), 2 * sizeof(uint16_t)); // 数据偏移、标志与窗口
+    hdr->chunksum16 = checksum_fold(sum + swap16(buf->len));
+    stats_inc(STATS_TCP_TX);
+    if (connect->version == IP_VERSION_6)
+        ipv6_out(buf, connect->ip, NET_PROTOCOL_TCP);
+    else
+        ip_out_df(buf, connect->ip, NET_PROTOCOL_TCP);
+    if (flags.syn || flags.fin) {
+        connect->next_seq += 1;
+    }
+    connect->ack_sent = connect->ack;
+    timer_cancel(&connect->delack_timer); // 确认已经随这个报文段发出
+    if (TCP_SEQ_LT(connect->rcv_adv, rcv_adv))
+        connect->rcv_adv = rcv_adv;
+
+    if (flags.rst || connect->next_seq == seq)
+        return;
+    if (TCP_SEQ_LT(connect->max_seq, connect->next_seq)) {
+        // Karn算法：部分重传的报文段不计时
+        if (!connect->rtt_start && TCP_SEQ_LEQ(connect->max_seq, seq)) {
+            connect->rtt_seq = connect->next_seq;
+            connect->rtt_start = timer_now();
+        }
+        connect->max_seq = connect->next_seq;
+    }
+    if (!timer_pending(&connect->rtx_timer))
+        timer_add(&connect->rtx_timer, connect->rto);
+}
+
+/**
+ * @brief 发送单个TCP包，见tcp_send_prepared
+ *
+ * @param buf
+ * @param connect
+ * @param flags
+ */
+static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
+    tcp_tmpl_t tmpl;
+    uint16_t vid = net_if_vlan;
+    net_if_select(connect->vlan);
+    tcp_hdr_prepare(connect, &tmpl);
+    tcp_send_prepared(buf, connect, &tmpl, flags);
+    net_if_select(vid);
+}
+
+/**
+ * @brief 在对端窗口允许的范围内把tx_buf中尚未发送的数据切成MSS大小的报文段连续发出，数据发完且正在关闭时带上FIN
+ *        一批报文段共用一个头部模板
+ *
+ * @param connect
+ * @param force_ack 没有数据可发且最新的确认号还没有发出时，发一个纯ACK
+ */
+static void tcp_output(tcp_connect_t* connect, int force_ack) {
+    tcp_tmpl_t tmpl;
+    uint16_t vid = net_if_vlan;
+    net_if_select(connect->vlan);
+    tcp_hdr_prepare(connect, &tmpl);
+    for (;;) {
+        uint16_t size = tcp_write_to_buf(connect, &txbuf);
+        int fin = tcp_fin_pending(connect);
+        if (!size && !fin) {
+            if (force_ack && connect->ack_sent != connect->ack)
+                tcp_send_prepared(&txbuf, connect, &tmpl, tcp_flags_ack);
+            net_if_select(vid);
+            return;
+        }
+        tcp_send_prepared(&txbuf, connect, &tmpl, fin ? tcp_flags_ack_fin : tcp_flags_ack);
+    }
+}
+
+/**
+ * @brief 在本批收包处理完后确认：放入待确认表，表已满时立即发出
+ *
+ * @param connect
+ */
+static void tcp_ack_later(tcp_connect_t* connect) {
+    if (connect->ack_now)
+        return;
+    if (ack_batch_num == NET_RX_BATCH) {
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack);
+        return;
+    }
+    ack_batch[ack_batch_num++] = connect;
+    connect->ack_now = 1;
+}
+
+/**
+ * @brief 收到新的按序数据后安排确认（RFC 1122、RFC 5681）：要求立即确认（FIN、PSH）
+ *        或未确认的数据达到两个满长报文段时在本批收包处理完后确认，否则启动延迟确认定时器。
+ *        在此之前发出的任何报文段都会捎带确认
+ *
+ * @param connect
+ * @param now 要求立即确认
+ */
+static void tcp_ack_schedule(tcp_connect_t* connect, int now) {
+    if (connect->ack_sent == connect->ack)
+        return; // 已经捎带在发出的数据上
+    if (now || connect->ack - connect->ack_sent >= 2u * connect->rcv_mss)
+        tcp_ack_later(connect);
+    else if (!timer_pending(&connect->delack_timer))
+        timer_add(&connect->delack_timer, TCP_DELACK_MS);
+}
+
+/**
+ * @brief 延迟确认定时器到期：期间没有数据可以捎带，发一个纯ACK
+ *
+ * @param arg 连接
+ */
+static void tcp_delack_timeout(void* arg) {
+    tcp_connect_t* connect = arg;
+    if (connect->ack_sent == connect->ack)
+        return;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_ack);
+}
+
+/**
+ * @brief 一批收包处理完后调用，释放这一批中关闭的连接，给本批中需要确认、又没有捎带确认的连接各发一个ACK
+ *
+ */
+void tcp_flush_acks() {
+    while (reap_list != NULL) {
+        tcp_connect_t* connect = reap_list;
+        reap_list = connect->reap_next;
+        free(connect);
+    }
+    for (uint32_t i = 0; i < ack_batch_num; i++) {
+        tcp_connect_t* connect = ack_batch[i];
+        connect->ack_now = 0;
+        if (connect->ack_sent != connect->ack) {
+            buf_init(&txbuf, 0);
+            tcp_send(&txbuf, connect, tcp_flags_ack);
+        }
+    }
+    ack_batch_num = 0;
+}
+
+/**
+ * @brief 用一次往返时间测量值更新SRTT/RTTVAR与RTO（Jacobson/Karels算法，RFC 6298）
+ *
+ * @param connect
+ * @param rtt 测量值，毫秒
+ */
+static void tcp_rtt_update(tcp_connect_t* connect, uint32_t rtt) {
+    if (rtt == 0)
+        rtt = 1;
+    if (connect->srtt == 0) {
+        connect->srtt = rtt;
+        connect->rttvar = rtt / 2;
+    } else {
+        uint32_t delta = connect->srtt > rtt ? connect->srtt - rtt : rtt - connect->srtt;
+        connect->rttvar = (3 * connect->rttvar + delta) / 4;
+        connect->srtt = (7 * connect->srtt + rtt) / 8;
+    }
+    uint32_t rto = connect->srtt + (4 * connect->rttvar > TIMER_TICK_MS ? 4 * connect->rttvar : TIMER_TICK_MS);
+    connect->rto = rto < TCP_RTO_MIN_MS ? TCP_RTO_MIN_MS : (rto > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : rto);
+}
+
+/**
+ * @brief 重传从seq开始的一个报文段，不超过MSS，也不覆盖对端已经SACK确认的数据，不影响后面已经发出的数据
+ *
+ * @param connect
+ * @param seq 起始序号
+ */
+static void tcp_retransmit(tcp_connect_t* connect, uint32_t seq) {
+    uint32_t next_seq = connect->next_seq;
+    uint32_t offset = seq - connect->unack_seq;
+    uint32_t tx_len = ring_len(&connect->tx_buf);
+    uint32_t len = offset < tx_len ? min32(tx_len - offset, tcp_mss(connect)) : 0;
+    for (int i = 0; i < connect->sacked_num; i++) {
+        if (TCP_SEQ_LT(seq, connect->sacked[i].start)) {
+            len = min32(len, connect->sacked[i].start - seq);
+            break;
+        }
+    }
+    buf_init(&txbuf, len);
+    if (len)
+        ring_peek(&connect->tx_buf, offset, txbuf.data, len);
+    connect->next_seq = seq + len;
+    tcp_send(&txbuf, connect, tcp_fin_pending(connect) ? tcp_flags_ack_fin : tcp_flags_ack);
+    connect->rtx_next = connect->next_seq;
+    if (TCP_SEQ_LT(connect->next_seq, next_seq))
+        connect->next_seq = next_seq;
+}
+
+/**
+ * @brief 快速恢复中重传下一个空缺
+ *        有SACK时空缺是最高的SACK区间以下没有被确认也还没有重传过的数据，每次重传一个；
+ *        没有SACK时只能重传最早未确认的报文段（NewReno）
+ *
+ * @param connect
+ */
+static void tcp_retransmit_hole(tcp_connect_t* connect) {
+    uint32_t seq = TCP_SEQ_LT(connect->rtx_next, connect->unack_seq) ? connect->unack_seq : connect->rtx_next;
+    if (connect->sacked_num) {
+        for (int i = 0; i < connect->sacked_num; i++)
+            if (TCP_SEQ_LEQ(connect->sacked[i].start, seq) && TCP_SEQ_LT(seq, connect->sacked[i].end))
+                seq = connect->sacked[i].end;
+        if (!TCP_SEQ_LT(seq, connect->sacked[connect->sacked_num - 1].start))
+            return;
+    } else if (seq != connect->unack_seq) {
+        return;
+    }
+    tcp_retransmit(connect, seq);
+}
+
+/**
+ * @brief 收到重复ACK：达到门限时快速重传并进入快速恢复，快速恢复中交给拥塞控制算法膨胀窗口，
+ *        有SACK时再重传下一个空缺
+ *
+ * @param connect
+ */
+static void tcp_dupack(tcp_connect_t* connect) {
+    if (connect->in_recovery) {
+        connect->cc->dupack(connect);
+        if (connect->sacked_num)
+            tcp_retransmit_hole(connect);
+        return;
+    }
+    if (++connect->dupacks != TCP_DUPACK_THRESH)
+        return;
+    // 重传超时后回退重发的数据引起的重复ACK不代表新的丢包（RFC 6582）
+    if (TCP_SEQ_LT(connect->unack_seq, connect->recover))
+        return;
+    connect->cc->loss(connect);
+    connect->recover = connect->max_seq;
+    connect->in_recovery = 1;
+    connect->rtt_start = 0;
+    connect->rtx_next = connect->unack_seq;
+    tcp_retransmit(connect, connect->unack_seq);
+    connect->cwnd = connect->ssthresh + TCP_DUPACK_THRESH * tcp_mss(connect);
+}
+
+/**
+ * @brief 把对端的SACK区间记入记分板，只接受已发出且未被累计确认的部分
+ *
+ * @param connect
+ * @param opts 报文段中的选项
+ */
+static void tcp_sack_update(tcp_connect_t* connect, const tcp_opts_t* opts) {
+    for (int i = 0; i < opts->sack_num; i++) {
+        const tcp_range_t* range = &opts->sack[i];
+        if (!TCP_SEQ_LT(range->start, range->end) || TCP_SEQ_LEQ(range->end, connect->unack_seq) ||
+            TCP_SEQ_LT(connect->max_seq, range->end))
+            continue;
+        uint32_t start = TCP_SEQ_LT(range->start, connect->unack_seq) ? connect->unack_seq : range->start;
+        tcp_range_insert(connect->sacked, &connect->sacked_num, TCP_SACKED_MAX, start, range->end);
+    }
+}
+
+/**
+ * @brief 累计确认前进后，去掉记分板中已经被累计确认的区间
+ *
+ * @param connect
+ */
+static void tcp_sack_prune(tcp_connect_t* connect) {
+    int n = 0;
+    while (n < connect->sacked_num && TCP_SEQ_LEQ(connect->sacked[n].end, connect->unack_seq))
+        n++;
+    memmove(connect->sacked, connect->sacked + n, (connect->sacked_num - n) * sizeof(tcp_range_t));
+    connect->sacked_num -= n;
+    if (connect->sacked_num && TCP_SEQ_LT(connect->sacked[0].start, connect->unack_seq))
+        connect->sacked[0].start = connect->unack_seq;
+}
+
+/**
+ * @brief 处理对端的确认号：释放已确认的数据，更新往返时间估计与拥塞窗口，重新设置重传定时器
+ *        快速恢复中的部分确认说明下一个报文段也丢了，立即重传（NewReno，RFC 6582）
+ *        使用时间戳时用回显的时间戳测量往返时间，重传的报文段也可以测量
+ *        对端以零窗口回应窗口探测时确认号不前进，这不是丢包：不算重复ACK，并清零重传次数，
+ *        对端一直通告零窗口时连接不会因为探测次数过多而中止
+ *
+ * @param connect
+ * @param ack_num 确认号
+ * @param dup 报文段不带数据且窗口没有变化，确认号没有前进时算作重复ACK
+ * @param opts 报文段中的选项
+ * @return int 确认了新的序号为1，否则为0
+ */
+static int tcp_ack(tcp_connect_t* connect, uint32_t ack_num, int dup, const tcp_opts_t* opts) {
+    if (connect->sack_ok)
+        tcp_sack_update(connect, opts);
+    if (ack_num == connect->unack_seq && connect->remote_win == 0) {
+        connect->retries = 0;
+        return 0;
+    }
+    if (ack_num == connect->unack_seq && dup && connect->unack_seq != connect->max_seq)
+        tcp_dupack(connect);
+    if (!TCP_SEQ_LT(connect->unack_seq, ack_num) || TCP_SEQ_LT(connect->max_seq, ack_num))
+        return 0;
+    if (connect->ts_ok && opts->ts_ok && opts->tsecr) {
+        tcp_rtt_update(connect, tcp_ts_now() - opts->tsecr);
+        connect->rtt_start = 0;
+    } else if (connect->rtt_start && TCP_SEQ_LEQ(connect->rtt_seq, ack_num)) {
+        tcp_rtt_update(connect, timer_now() - connect->rtt_start);
+        connect->rtt_start = 0;
+    }
+
+    // SYN和FIN各占一个序号但不在tx_buf中
+    uint32_t acked = ack_num - connect->unack_seq;
+    uint32_t tx_len = ring_len(&connect->tx_buf);
+    if (acked > tx_len && connect->state != TCP_SYN_RCVD && connect->state != TCP_SYN_SEND)
+        connect->fin_acked = 1;
+    ring_consume(&connect->tx_buf, min32(acked, tx_len));
+    connect->unack_seq = ack_num;
+    if (TCP_SEQ_LT(connect->next_seq, ack_num))
+        connect->next_seq = ack_num; // 回退重传后收到了更靠后的确认
+    tcp_sack_prune(connect);
+
+    connect->retries = 0;
+    connect->dupacks = 0;
+    if (!connect->in_recovery) {
+        if (connect->state != TCP_SYN_RCVD)
+            connect->cc->ack(connect, acked);
+    } else if (TCP_SEQ_LEQ(connect->recover, ack_num)) {
+        connect->in_recovery = 0;
+        connect->cwnd = connect->ssthresh; // 完全确认，窗口收缩到ssthresh
+    } else {
+        // 部分确认：减去确认的数据，加回一个MSS，重传下一个空缺
+        connect->cwnd = (connect->cwnd > acked ? connect->cwnd - acked : 0) + tcp_mss(connect);
+        tcp_retransmit_hole(connect);
+    }
+
+    if (connect->unack_seq == connect->max_seq)
+        timer_cancel(&connect->rtx_timer);
+    else
+        timer_add(&connect->rtx_timer, connect->rto);
+    if (connect->state == TCP_ESTABLISHED)
+        event_post(&connect->event, EVENT_WRITABLE); // 确认腾出了发送空间
+    return 1;
+}
+
+/**
+ * @brief 以state调用连接的回调函数，只使用就绪事件的连接没有回调函数
+ *
+ * @param connect
+ * @param handler 回调函数，可以为NULL
+ * @param state
+ */
+static void tcp_notify(tcp_connect_t* connect, tcp_handler_t handler, connect_state_t state) {
+    if (handler == NULL)
+        return;
+    LATENCY_MARK(LATENCY_STAGE_TRANSPORT);
+    (*handler)(connect, state);
+    LATENCY_MARK(LATENCY_STAGE_HANDLER);
+}
+
+/**
+ * @brief 协议栈关闭连接前以TCP_CONN_CLOSED通知应用层。
+ *        三次握手没有完成、还在全连接队列中、或者应用层已经关闭的连接，应用层不知道或不再关心，不通知
+ *
+ * @param connect
+ */
+static void tcp_notify_closed(tcp_connect_t* connect) {
+    if (connect->state != TCP_SYN_RCVD && !connect->accepting && !connect->user_closed)
+        tcp_notify(connect, connect->handler, TCP_CONN_CLOSED);
+}
+
+/**
+ * @brief 中止连接：发送RST，通知应用层连接关闭，释放连接
+ *
+ * @param connect
+ */
+static void tcp_abort(tcp_connect_t* connect) {
+    stats_inc(STATS_TCP_RESET);
+    if (connect->state != TCP_SYN_SEND) {
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack_rst);
+    }
+    tcp_notify_closed(connect);
+    release_tcp_connect(connect);
+}
+
+/**
+ * @brief 重传定时器到期：RTO加倍退避，从最早未确认的序号开始重传一个报文段，
+ *        其余数据等新的确认到来后由tcp_output补发；重传次数过多则中止连接。
+ *        对端窗口为0时这是窗口探测（持续定时器），不是丢包，不通知拥塞控制
+ *
+ * @param arg 连接
+ */
+static void tcp_rtx_timeout(void* arg) {
+    tcp_connect_t* connect = arg;
+    if (++connect->retries > TCP_RTX_MAX_RETRIES) {
+        tcp_abort(connect);
+        return;
+    }
+    connect->rto = connect->rto * 2 > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : connect->rto * 2;
+    connect->rtt_start = 0;
+    if (connect->state != TCP_SYN_RCVD && connect->state != TCP_SYN_SEND && connect->remote_win)
+        connect->cc->rto(connect);
+    connect->in_recovery = 0;
+    connect->dupacks = 0;
+    connect->recover = connect->max_seq;
+    connect->sacked_num = 0; // 超时后不再相信之前的SACK信息（RFC 2018）
+    connect->next_seq = connect->unack_seq;
+    if (connect->state == TCP_SYN_RCVD || connect->state == TCP_SYN_SEND) {
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, connect->state == TCP_SYN_SEND ? tcp_flags_syn : tcp_flags_ack_syn);
+        return;
+    }
+    tcp_write_to_buf(connect, &txbuf);
+    tcp_send(&txbuf, connect, tcp_fin_pending(connect) ? tcp_flags_ack_fin : tcp_flags_ack);
+}
+
+/**
+ * @brief 保活定时器到期（RFC 1122）：
+ *        应用层关闭后的FIN_WAIT_2中对端空闲超过TCP_FIN_WAIT2_MS时复位并释放连接；
+ *        有数据在途时由重传定时器判断对端是否还在，过一个空闲时间再看；
+ *        空闲达到ka_idle后每隔ka_intvl发一个序号为unack_seq - 1的空报文段，对端必须回复ACK，
+ *        连续ka_probes次没有回应则中止连接。收到任何报文段都会重新计算空闲时间
+ *
+ * @param arg 连接
+ */
+static void tcp_keepalive_timeout(void* arg) {
+    tcp_connect_t* connect = arg;
+    uint64_t idle = timer_now() - connect->rx_stamp;
+    if (connect->state == TCP_FIN_WAIT_2) {
+        if (idle < TCP_FIN_WAIT2_MS) {
+            timer_add(&connect->ka_timer, TCP_FIN_WAIT2_MS - idle);
+            return;
+        }
+        stats_inc(STATS_TCP_FIN_WAIT2_TIMEOUT);
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack_rst);
+        release_tcp_connect(connect);
+        return;
+    }
+    if (!connect->ka_idle)
+        return;
+    if (timer_pending(&connect->rtx_timer)) {
+        timer_add(&connect->ka_timer, connect->ka_idle);
+        return;
+    }
+    if (connect->ka_sent == 0 && idle < connect->ka_idle) {
+        timer_add(&connect->ka_timer, connect->ka_idle - idle);
+        return;
+    }
+    if (connect->ka_sent >= connect->ka_probes) {
+        stats_inc(STATS_TCP_KEEPALIVE_TIMEOUT);
+        tcp_abort(connect);
+        return;
+    }
+    uint32_t next_seq = connect->next_seq;
+    connect->next_seq = connect->unack_seq - 1;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_ack);
+    connect->next_seq = next_seq;
+    connect->ka_sent++;
+    stats_inc(STATS_TCP_KEEPALIVE_PROBE);
+    timer_add(&connect->ka_timer, connect->ka_intvl);
+}
+
+/**
+ * @brief 为主动打开分配一个本地临时端口，不能是监听端口，也不能与到同一对端地址和端口的已有连接或TIME_WAIT记录冲突
+ *
+ * @param ip 对端地址
+ * @param local_ip 本端地址
+ * @param version
+ * @param port 对端端口
+ * @return uint16_t 端口号，没有可用的端口为0
+ */
+static uint16_t tcp_ephemeral_port(uint8_t* ip, uint8_t* local_ip, uint8_t version, uint16_t port) {
+    uint32_t range = TCP_EPHEMERAL_MAX - TCP_EPHEMERAL_MIN + 1;
+    for (uint32_t i = 0; i < range; i++) {
+        uint16_t local_port = TCP_EPHEMERAL_MIN + ephemeral_next++ % range;
+        if (map_get(&tcp_table, &local_port))
+            continue;
+        tcp_key_t key = new_tcp_key(ip, local_ip, version, port, local_port);
+        uint32_t hash = tcp_key_hash(&key);
+        if (tcp_hash_get(&connect_table, &key, hash) || tcp_hash_get(&tw_table, &key, hash))
+            continue;
+        return local_port;
+    }
+    return 0;
+}
+
+/**
+ * @brief 主动打开，ipv4与ipv6共用：分配临时端口，提出全部选项后发送SYN，进入TCP_SYN_SEND状态
+ *
+ * @param ip 对端地址
+ * @param version
+ * @param port 对端端口
+ * @param handler 连接的回调函数
+ * @return tcp_connect_t* 新的连接，失败为NULL
+ */
+static tcp_connect_t* tcp_connect_version(uint8_t* ip, uint8_t version, uint16_t port, tcp_handler_t handler) {
+    uint8_t* local_ip = version == IP_VERSION_6 ? ipv6_src_for(ip) : net_if_ip;
+    uint16_t local_port = tcp_ephemeral_port(ip, local_ip, version, port);
+    if (!local_port)
+        return NULL;
+    tcp_key_t key = new_tcp_key(ip, local_ip, version, port, local_port);
+    tcp_connect_t* connect = tcp_connect_new(&key, NULL);
+    if (connect == NULL)
+        return NULL;
+    if (init_tcp_connect_rcvd(connect) != 0) {
+        tcp_connect_unlink(connect);
+        free(connect);
+        return NULL;
+    }
+    connect->state = TCP_SYN_SEND;
+    connect->owned = 1;
+
+    connect->local_port = local_port;
+    connect->remote_port = port;
+    memcpy(connect->ip, key.ip, NET_IP6_LEN);
+    connect->version = version;
+    connect->vlan = net_if_vlan;
+    connect->handler = handler;
+
+    connect->unack_seq = tcp_iss_new();
+    connect->next_seq = connect->unack_seq;
+    connect->max_seq = connect->unack_seq;
+    connect->recover = connect->unack_seq;
+    connect->snd_sml = connect->unack_seq;
+    connect->ack = 0;
+    connect->rcv_adv = 0;
+    connect->remote_win = 0; // 收到SYN+ACK之前不发送数据，写入的数据留在发送缓存中
+
+    // 对端在SYN+ACK中带回的选项才会启用，见tcp_negotiate
+    connect->remote_mss = version == IP_VERSION_6 ? TCP_DEFAULT_MSS6 : TCP_DEFAULT_MSS;
+    connect->snd_wscale = 0;
+    connect->rcv_wscale = tcp_rcv_wscale();
+    connect->sack_ok = 1;
+    connect->ts_ok = 1;
+    connect->ts_recent = 0;
+    connect->sacked_num = 0;
+
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, connect, tcp_flags_syn);
+    return connect;
+}
+
+/**
+ * @brief 向ipv4对端发起TCP连接，建立后以TCP_CONN_CONNECTED调用handler，失败以TCP_CONN_CLOSED调用
+ *        返回的句柄归应用层所有，连接关闭后仍然有效，用完后调用tcp_connect_close释放
+ *        连接建立在当前选择的vlan上（默认不带标签），要用vlan子接口时先调用net_if_select
+ *        供应用层使用
+ *
+ * @param ip 对端地址
+ * @param port 对端端口
+ * @param handler 连接的回调函数
+ * @return tcp_connect_t* 新的连接，失败为NULL
+ */
+tcp_connect_t* tcp_connect(uint8_t* ip, uint16_t port, tcp_handler_t handler) {
+    return tcp_connect_version(ip, IP_VERSION_4, port, handler);
+}
+
+/**
+ * @brief 向ipv6对端发起TCP连接，见tcp_connect
+ *        供应用层使用
+ *
+ * @param ip 对端地址
+ * @param port 对端端口
+ * @param handler 连接的回调函数
+ * @return tcp_connect_t* 新的连接，失败为NULL
+ */
+tcp_connect_t* tcp6_connect(uint8_t* ip, uint16_t port, tcp_handler_t handler) {
+    return tcp_connect_version(ip, IP_VERSION_6, port, handler);
+}
+
+/**
+ * @brief 从外部关闭一个TCP连接, 会发送剩余数据，之后应用层不能再使用这个句柄
+ *        已建立的连接发完数据后发送FIN，由协议栈完成关闭后释放；其他状态的连接立即关闭；
+ *        协议栈已经关闭（TCP_CLOSED）的连接在这里释放。重复调用没有作用。
+ *        tcp_connect、tcp_accept返回的句柄在协议栈关闭连接后仍然有效，必须调用这个函数释放；
+ *        tcp_open的连接在以TCP_CONN_CLOSED回调之后由协议栈释放
+ *        供应用层使用
+ *
+ * @param connect
+ */
+void tcp_connect_close(tcp_connect_t* connect) {
+    if (connect->user_closed)
+        return;
+    connect->user_closed = 1;
+    connect->owned = 0;
+    event_watch(&connect->event, 0, NULL, 0); // 应用层不再使用这个连接，之后的事件都不报告
+    if (connect->state == TCP_CLOSED) {
+        tcp_connect_free(connect);
+        return;
+    }
+    if (connect->state == TCP_ESTABLISHED) {
+        connect->state = TCP_FIN_WAIT_1;
+        tcp_output(connect, 0);
+        return;
+    }
+    release_tcp_connect(connect);
+}
+
+/**
+ * @brief 窗口回到初始值并初始化连接已选的拥塞控制算法，握手完成协商出MSS后调用
+ *
+ * @param connect
+ */
+static void tcp_cc_reset(tcp_connect_t* connect) {
+    connect->cwnd = TCP_INIT_CWND * tcp_mss(connect);
+    connect->ssthresh = UINT32_MAX;
+    connect->dupacks = 0;
+    connect->in_recovery = 0;
+    connect->cc->init(connect);
+}
+
+/**
+ * @brief 为连接选择拥塞控制算法，握手完成前只记录选择，之后窗口回到初始值
+ *        供应用层使用
+ *
+ * @param connect
+ * @param cc 算法
+ * @return int 成功为0，不支持的算法为-1
+ */
+int tcp_connect_set_cc(tcp_connect_t* connect, tcp_cc_t cc) {
+    const tcp_cc_ops_t* ops = tcp_cc_get(cc);
+    if (ops == NULL)
+        return -1;
+    connect->cc = ops;
+    if (connect->state != TCP_SYN_SEND && connect->state != TCP_SYN_RCVD)
+        tcp_cc_reset(connect);
+    return 0;
+}
+
+/**
+ * @brief 打开或关闭连接的NODELAY，打开后不再用Nagle算法推迟小报文段，已推迟的数据立即发出
+ *        供应用层使用
+ *
+ * @param connect
+ * @param nodelay 非0为打开
+ */
+void tcp_connect_set_nodelay(tcp_connect_t* connect, uint8_t nodelay) {
+    connect->nodelay = nodelay != 0;
+    if (connect->nodelay && connect->state == TCP_ESTABLISHED)
+        tcp_output(connect, 0);
+}
+
+/**
+ * @brief 设置或取消连接的cork：cork期间写入的数据攒够MSS才发出，适合分多次写入一个响应；
+ *        取消时把攒下的数据全部发出
+ *        供应用层使用
+ *
+ * @param connect
+ * @param cork 非0为设置
+ */
+void tcp_connect_set_cork(tcp_connect_t* connect, uint8_t cork) {
+    connect->cork = cork != 0;
+    if (!connect->cork && connect->state == TCP_ESTABLISHED) {
+        connect->snd_sml = connect->unack_seq; // 取消cork时不受Nagle限制
+        tcp_output(connect, 0);
+    }
+}
+
+/**
+ * @brief 设置连接的保活探测：空闲idle_ms毫秒后每隔intvl_ms毫秒探测一次，连续probes次没有回应则中止连接，
+ *        以TCP_CONN_CLOSED调用handler；新连接使用TCP_KEEPALIVE_IDLE_MS等默认值
+ *        供应用层使用
+ *
+ * @param connect
+ * @param idle_ms 空闲多久后开始探测，0表示关闭保活
+ * @param intvl_ms 探测间隔
+ * @param probes 最多探测次数
+ */
+void tcp_connect_set_keepalive(tcp_connect_t* connect, uint32_t idle_ms, uint32_t intvl_ms, uint8_t probes) {
+    connect->ka_idle = idle_ms;
+    connect->ka_intvl = intvl_ms;
+    connect->ka_probes = probes;
+    connect->ka_sent = 0;
+    if (connect->state == TCP_FIN_WAIT_2 || connect->state == TCP_CLOSED)
+        return; // 定时器正用于FIN_WAIT_2超时，或者连接已经关闭
+    timer_cancel(&connect->ka_timer);
+    if (idle_ms)
+        timer_add(&connect->ka_timer, idle_ms);
+}
+
+/**
+ * @brief 从 connect 中读取数据到 buf，返回成功的字节数。
+ *        供应用层使用
+ *
+ * @param connect
+ * @param data
+ * @param len
+ * @return size_t
+ */
+size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
+    size_t size = ring_read(&connect->rx_buf, data, len > UINT32_MAX ? UINT32_MAX : len);
+    // 读走数据腾出的空间足够多时通告新的窗口，对端可能正因为零窗口停止发送
+    if (size && (connect->state == TCP_ESTABLISHED || connect->state == TCP_FIN_WAIT_1 || connect->state == TCP_FIN_WAIT_2)
+        && tcp_window_update_due(connect)) {
+        tcp_output(connect, 0);
+        if (tcp_window_update_due(connect)) {
+            buf_init(&txbuf, 0);
+            tcp_send(&txbuf, connect, tcp_flags_ack);
+        }
+    }
+    return size;
 }
 
-// dst-port -> handler
-static map_t tcp_table; //tcp_table里面放了一个dst_port的回调函数
+/**
+ * @brief 关注连接的就绪事件，由event_get取出。注册时已经满足的事件立即报告一次，
+ *        之后按边沿触发：只有收到新数据、腾出新的发送空间或连接关闭时才再次报告
+ *        供应用层使用
+ *
+ * @param connect
+ * @param interest 关注的事件，0表示取消
+ * @param data 用户数据，随事件返回
+ */
+void tcp_connect_watch(tcp_connect_t* connect, uint8_t interest, void* data) {
+    uint8_t ready = connect->state == TCP_CLOSED ? EVENT_CLOSED : 0;
+    if (ring_len(&connect->rx_buf) || connect->state == TCP_LAST_ACK)
+        ready |= EVENT_READABLE; // 对端已经关闭时读到0表示数据结束
+    if (connect->state == TCP_ESTABLISHED && ring_space(&connect->tx_buf) && connect->next_seq - connect->unack_seq < connect->remote_win)
+        ready |= EVENT_WRITABLE;
+    event_watch(&connect->event, interest, data, ready);
+}
 
-// tcp_key_t[IP, src port, dst port] -> tcp_connect_t
+/**
+ * @brief 往connect的tx_buf里面写东西，返回成功的字节数，只受发送缓存剩余空间限制。
+ *        对端窗口由tcp_output控制，已建立的连接会立即尝试发送。
+ *        供应用层使用
+ *
+ * @param connect
+ * @param data
+ * @param len
+ */
+size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
+    // printf("tcp_connect_write size: %zu\n", len);
+    if (connect->state == TCP_CLOSED)
+        return 0;
+    size_t size = ring_write(&connect->tx_buf, data, len > UINT32_MAX ? UINT32_MAX : len);
+#ifdef LATENCY
+    if (size && !connect->tx_stamp)
+        connect->tx_stamp = latency_now();
+#endif
+    if (connect->state == TCP_ESTABLISHED)
+        tcp_output(connect, 0);
+    return size;
+}
 
-/* Connect_table放置了一堆TCP连接，
-    KEY为[IP，src port，dst port], 即tcp_key_t，VALUE为tcp_connect_t。
-*/
-static map_t connect_table; 
+/**
+ * @brief 用对端SYN的信息填充被动打开的连接并协商选项，状态设为TCP_SYN_RCVD，不分配缓存
+ *
+ * @param connect
+ * @param key 连接的键
+ * @param vlan 连接所在的vlan
+ * @param iss 本端初始序号
+ * @param irs 对端初始序号
+ * @param remote_win 对端SYN中的窗口
+ * @param opts 对端SYN中的选项
+ */
+static void tcp_syn_fill(tcp_connect_t* connect, const tcp_key_t* key, uint16_t vlan, uint32_t iss, uint32_t irs,
+                         uint32_t remote_win, const tcp_opts_t* opts) {
+    connect->state = TCP_SYN_RCVD;
+    connect->local_port = key->dst_port;
+    connect->remote_port = key->src_port;
+    memcpy(connect->ip, key->ip, NET_IP6_LEN);
+    connect->version = key->version;
+    connect->vlan = vlan;
+    connect->unack_seq = iss;
+    connect->next_seq = iss + 1;
+    connect->max_seq = iss + 1;
+    connect->recover = iss;
+    connect->snd_sml = iss;
+    connect->ack = irs + 1;
+    connect->ack_sent = connect->ack; // 已经由SYN+ACK确认
+    connect->rcv_adv = connect->ack + min32(TCP_RCV_BUF_SIZE, UINT16_MAX); // SYN+ACK中通告的窗口不扩大
+    connect->remote_win = remote_win;
+    tcp_negotiate(connect, opts);
+}
 
 /**
- * @brief 生成一个用于 connect_table 的 key
+ * @brief 不建立连接地回复SYN+ACK，用于半连接和SYN cookie
+ *        在栈上构造临时连接，接收缓存只有容量没有存储区，通告空缓存的窗口；重传由调用者负责
  *
- * @param ip
- * @param src_port
- * @param dst_port
- * @return tcp_key_t
+ * @param key 连接的键
+ * @param vlan
+ * @param iss 本端初始序号
+ * @param irs 对端初始序号
+ * @param remote_win 对端SYN中的窗口
+ * @param opts 对端SYN中的选项
  */
-static tcp_key_t new_tcp_key(uint8_t ip[NET_IP_LEN], uint16_t src_port, uint16_t dst_port) {
-    tcp_key_t key;
-    memcpy(key.ip, ip, NET_IP_LEN);
-    key.src_port = src_port;
-    key.dst_port = dst_port;
-    return key;
+static void tcp_syn_ack_send(const tcp_key_t* key, uint16_t vlan, uint32_t iss, uint32_t irs, uint32_t remote_win,
+                             const tcp_opts_t* opts) {
+    tcp_connect_t connect = CONNECT_LISTEN;
+    tcp_syn_fill(&connect, key, vlan, iss, irs, remote_win, opts);
+    connect.next_seq = iss;
+    connect.rx_buf.size = TCP_RCV_BUF_SIZE;
+    connect.rto = TCP_RTO_INIT_MS;
+    timer_setup(&connect.rtx_timer, NULL, NULL);
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, &connect, tcp_flags_ack_syn);
+    timer_cancel(&connect.rtx_timer);
 }
 
 /**
- * @brief 初始化tcp在静态区的map
- *        供应用层使用
+ * @brief 删除半连接
  *
+ * @param syn
  */
-void tcp_init() {
-    map_init(&tcp_table, sizeof(uint16_t), sizeof(tcp_handler_t), 0, 0, NULL);
-    map_init(&connect_table, sizeof(tcp_key_t), sizeof(tcp_connect_t), 0, 0, NULL);
-    net_add_protocol(NET_PROTOCOL_TCP, tcp_in);
+static void tcp_syn_drop(tcp_syn_t* syn) {
+    tcp_listener_t* listener = map_get(&tcp_table, &syn->key.dst_port);
+    if (listener && listener->syn_num)
+        listener->syn_num--;
+    timer_cancel(&syn->timer);
+    tcp_hash_remove(&syn_table, syn, syn->hash);
+    *syn->pprev = syn->next;
+    if (syn->next)
+        syn->next->pprev = syn->pprev;
+    free(syn);
 }
 
 /**
- * @brief 向 port 注册一个 TCP 连接以及关联的回调函数
- *        供应用层使用
+ * @brief 半连接的重传定时器到期：RTO加倍后重传SYN+ACK，次数过多则删除半连接
  *
- * @param port
- * @param handler
- * @return int
+ * @param arg 半连接
  */
-int tcp_open(uint16_t port, tcp_handler_t handler) {
-    printf("tcp open\n");
-    return map_set(&tcp_table, &port, &handler);
+static void tcp_syn_timeout(void* arg) {
+    tcp_syn_t* syn = arg;
+    if (++syn->retries > TCP_SYN_RETRIES) {
+        stats_inc(STATS_TCP_SYN_TIMEOUT);
+        tcp_syn_drop(syn);
+        return;
+    }
+    syn->rto = syn->rto * 2 > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : syn->rto * 2;
+    tcp_syn_ack_send(&syn->key, syn->vlan, syn->iss, syn->irs, syn->remote_win, &syn->opts);
+    timer_add(&syn->timer, syn->rto);
 }
 
 /**
- * @brief 完成了缓存分配工作，状态也会切换为TCP_SYN_RCVD
- *        rx_buf和tx_buf在触及边界时会把数据重新移动到头部，防止溢出。
+ * @brief 在半连接队列中记下对端的SYN并回复SYN+ACK
  *
- * @param connect
+ * @param listener 监听端口
+ * @param key 连接的键
+ * @param hash 键的哈希值
+ * @param iss 本端初始序号
+ * @param irs 对端初始序号
+ * @param remote_win 对端SYN中的窗口
+ * @param opts 对端SYN中的选项
+ * @return int 成功为0，队列已满或内存不足为-1
  */
-static void init_tcp_connect_rcvd(tcp_connect_t* connect) {
-    if (connect->state == TCP_LISTEN) {
-        connect->rx_buf = malloc(sizeof(buf_t));
-        connect->tx_buf = malloc(sizeof(buf_t));
+static int tcp_syn_queue(tcp_listener_t* listener, const tcp_key_t* key, uint32_t hash, uint32_t iss, uint32_t irs,
+                         uint32_t remote_win, const tcp_opts_t* opts) {
+    if (listener->syn_num >= TCP_SYN_BACKLOG)
+        return -1;
+    tcp_syn_t* syn = malloc(sizeof(tcp_syn_t));
+    if (syn == NULL)
+        return -1;
+    *syn = (tcp_syn_t){
+        .key = *key,
+        .hash = hash,
+        .iss = iss,
+        .irs = irs,
+        .remote_win = remote_win,
+        .opts = *opts,
+        .vlan = net_if_vlan,
+        .retries = 0,
+        .rto = TCP_RTO_INIT_MS,
+        .sent = timer_now(),
+    };
+    if (tcp_hash_add(&syn_table, syn, hash) != 0) {
+        free(syn);
+        return -1;
     }
-    buf_init(connect->rx_buf, 0);
-    buf_init(connect->tx_buf, 0);
-    connect->state = TCP_SYN_RCVD;
+    syn->next = listener->syns;
+    if (syn->next)
+        syn->next->pprev = &syn->next;
+    syn->pprev = &listener->syns;
+    listener->syns = syn;
+    timer_setup(&syn->timer, tcp_syn_timeout, syn);
+    listener->syn_num++;
+    tcp_syn_ack_send(key, syn->vlan, syn->iss, irs, remote_win, opts);
+    timer_add(&syn->timer, syn->rto);
+    return 0;
 }
 
 /**
- * @brief 释放TCP连接，这会释放分配的空间，并把状态变回LISTEN。
- *        一般这个后边都会跟个map_delete(&connect_table, &key)把状态变回CLOSED
+ * @brief SYN cookie能编码的MSS，用3位下标表示
  *
- * @param connect
  */
-static void release_tcp_connect(tcp_connect_t* connect) {
-    if (connect->state == TCP_LISTEN)
-        return;
-    free(connect->rx_buf);
-    free(connect->tx_buf);
-    connect->state = TCP_LISTEN;
+static const uint16_t tcp_cookie_mss[8] = {216, 536, 1024, 1220, 1300, 1400, 1440, 1460};
+
+/**
+ * @brief 计算SYN cookie中的散列值：连接的键、对端初始序号、时间片和MSS下标在syn_secret下的SipHash，
+ *        cookie中明文的时间片和MSS下标都不能被改动
+ *
+ * @param key 连接的键
+ * @param irs 对端初始序号
+ * @param t 时间片
+ * @param m MSS下标
+ * @return uint32_t 散列值
+ */
+static uint32_t tcp_cookie_hash(const tcp_key_t* key, uint32_t irs, uint32_t t, uint32_t m) {
+    struct {
+        tcp_key_t key;
+        uint32_t irs, t, m;
+    } msg;
+    memset(&msg, 0, sizeof(msg)); // 按字节散列，填充字节也要清零
+    msg.key = *key;
+    msg.irs = irs;
+    msg.t = t;
+    msg.m = m;
+    return (uint32_t)siphash24(syn_secret, &msg, sizeof(msg));
 }
 
-static uint16_t tcp_checksum(buf_t* buf, uint8_t* src_ip, uint8_t* dst_ip) {
-    uint16_t len = (uint16_t)buf->len;
-    tcp_peso_hdr_t* peso_hdr = (tcp_peso_hdr_t*)(buf->data - sizeof(tcp_peso_hdr_t));
-    tcp_peso_hdr_t pre; //暂存被覆盖的IP头
-    memcpy(&pre, peso_hdr, sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr->src_ip, src_ip, NET_IP_LEN);
-    memcpy(peso_hdr->dst_ip, dst_ip, NET_IP_LEN);
-    peso_hdr->placeholder = 0;
-    peso_hdr->protocol = NET_PROTOCOL_TCP;
-    peso_hdr->total_len16 = swap16(len);
-    uint16_t checksum = checksum16((uint16_t*)peso_hdr, len + sizeof(tcp_peso_hdr_t));
-    memcpy(peso_hdr, &pre, sizeof(tcp_peso_hdr_t));
-    return checksum;
+/**
+ * @brief 当前的SYN cookie时间片，每片64秒，取低5位
+ *
+ * @return uint32_t 时间片
+ */
+static inline uint32_t tcp_cookie_time() {
+    return (timer_now() / 1000 >> 6) & 0x1f;
 }
 
-static _Thread_local uint16_t delete_port;
+/**
+ * @brief 生成SYN cookie作为本端初始序号：高5位时间片，接着3位MSS下标，低24位散列值
+ *
+ * @param key 连接的键
+ * @param irs 对端初始序号
+ * @param mss 对端的MSS，改为cookie能编码的不超过它的最大值
+ * @return uint32_t 本端初始序号
+ */
+static uint32_t tcp_cookie_make(const tcp_key_t* key, uint32_t irs, uint16_t* mss) {
+    uint32_t t = tcp_cookie_time();
+    int m = 7;
+    while (m > 0 && tcp_cookie_mss[m] > *mss)
+        m--;
+    *mss = tcp_cookie_mss[m];
+    return t << 27 | (uint32_t)m << 24 | (tcp_cookie_hash(key, irs, t, m) & 0xffffff);
+}
 
 /**
- * @brief tcp_close使用这个函数来查找可以关闭的连接，使用thread-local变量delete_port传递端口号。
+ * @brief 校验第三次握手确认的SYN cookie，只接受当前和上一个时间片
  *
- * @param key,value,timestamp
+ * @param key 连接的键
+ * @param irs 对端初始序号
+ * @param cookie 本端初始序号
+ * @param mss 校验通过时写入cookie中的MSS
+ * @return int 成功为0，失败为-1
  */
-static void close_port_fn(void* key, void* value, time_t* timestamp) {
-    tcp_key_t* tcp_key = key;
-    tcp_connect_t* connect = value;
-    if (tcp_key->dst_port == delete_port) {
-        release_tcp_connect(connect);
-    }
+static int tcp_cookie_check(const tcp_key_t* key, uint32_t irs, uint32_t cookie, uint16_t* mss) {
+    uint32_t t = cookie >> 27;
+    uint32_t m = cookie >> 24 & 0x7;
+    if (((tcp_cookie_time() - t) & 0x1f) > 1)
+        return -1;
+    if ((tcp_cookie_hash(key, irs, t, m) & 0xffffff) != (cookie & 0xffffff))
+        return -1;
+    *mss = tcp_cookie_mss[m];
+    return 0;
 }
 
 /**
- * @brief 关闭 port 上的 TCP 连接
- *        供应用层使用
+ * @brief 把TIME_WAIT记录从时间轮中取下
  *
- * @param port
+ * @param tw
  */
-void tcp_close(uint16_t port) {
-    delete_port = port;
-    map_foreach(&connect_table, close_port_fn);
-    map_delete(&tcp_table, &port);
+static void tcp_tw_unlink(tcp_tw_t* tw) {
+    *tw->pprev = tw->next;
+    if (tw->next)
+        tw->next->pprev = tw->pprev;
 }
 
 /**
- * @brief 从 buf 中读取数据到 connect->rx_buf
+ * @brief 把TIME_WAIT记录挂到时间轮上刚回收过的槽，转一整圈后回收，持续时间比TCP_TIME_WAIT_MS最多少一个槽
  *
- * @param connect
- * @param buf
- * @return uint16_t 字节数
+ * @param tw
  */
-static uint16_t tcp_read_from_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint8_t* dst = connect->rx_buf->data + connect->rx_buf->len;
-    buf_add_padding(connect->rx_buf, buf->len);
-    memcpy(dst, buf->data, buf->len);
-    connect->ack += buf->len;
-    return buf->len;
+static void tcp_tw_link(tcp_tw_t* tw) {
+    tcp_tw_t** head = &tw_wheel[(tw_slot + TCP_TW_SLOTS - 1) % TCP_TW_SLOTS];
+    tw->next = *head;
+    if (tw->next)
+        tw->next->pprev = &tw->next;
+    tw->pprev = head;
+    *head = tw;
+    if (!timer_pending(&tw_timer))
+        timer_add(&tw_timer, TCP_TIME_WAIT_MS / TCP_TW_SLOTS);
 }
 
 /**
- * @brief 把connect内tx_buf的数据写入到buf里面供tcp_send使用，buf原来的内容会无效。
+ * @brief 删除TIME_WAIT记录
  *
- * @param connect
- * @param buf
- * @return uint16_t 字节数
+ * @param tw
  */
-static uint16_t tcp_write_to_buf(tcp_connect_t* connect, buf_t* buf) {
-    uint16_t sent = connect->next_seq - connect->unack_seq;
-    uint16_t size = min32(connect->tx_buf->len - sent, connect->remote_win);
-    buf_init(buf, size);
-    memcpy(buf->data, connect->tx_buf->data + sent, size);
-    connect->next_seq += size;
-    return size;
+static void tcp_tw_free(tcp_tw_t* tw) {
+    tcp_tw_unlink(tw);
+    tcp_hash_remove(&tw_table, tw, tw->hash);
+    free(tw);
 }
 
 /**
- * @brief 发送TCP包, seq_number32 = connect->next_seq - buf->len
- *        buf里的数据将作为负载，加上tcp头发送出去。如果flags包含syn或fin，seq会递增。
+ * @brief 时间轮定时器到期：回收当前槽中的所有记录，还有记录时继续计时
  *
- * @param buf
- * @param connect
- * @param flags
+ * @param arg 未使用
  */
-static void tcp_send(buf_t* buf, tcp_connect_t* connect, tcp_flags_t flags) {
-    // printf("<< tcp send >> sz=%zu\n", buf->len);
-    display_flags(flags);
-    size_t prev_len = buf->len;
-    buf_add_header(buf, sizeof(tcp_hdr_t));
-    tcp_hdr_t* hdr = (tcp_hdr_t*)buf->data;
-    hdr->src_port16 = swap16(connect->local_port);
-    hdr->dst_port16 = swap16(connect->remote_port);
-    hdr->seq_number32 = swap32(connect->next_seq - prev_len);
-    hdr->ack_number32 = swap32(connect->ack);
-    hdr->data_offset = sizeof(tcp_hdr_t) / sizeof(uint32_t);
-    hdr->reserved = 0;
-    hdr->flags = flags;
-    hdr->window_size16 = swap16(connect->remote_win);
-    hdr->chunksum16 = 0;
-    hdr->urgent_pointer16 = 0;
-    hdr->chunksum16 = tcp_checksum(buf, connect->ip, net_if_ip);
-    ip_out(buf, connect->ip, NET_PROTOCOL_TCP);
-    if (flags.syn || flags.fin) {
-        connect->next_seq += 1;
-    }
+static void tcp_tw_timeout(void* arg) {
+    (void)arg;
+    while (tw_wheel[tw_slot] != NULL)
+        tcp_tw_free(tw_wheel[tw_slot]);
+    tw_slot = (tw_slot + 1) % TCP_TW_SLOTS;
+    if (tw_table.num)
+        timer_add(&tw_timer, TCP_TIME_WAIT_MS / TCP_TW_SLOTS);
 }
 
 /**
- * @brief 从外部关闭一个TCP连接, 会发送剩余数据
- *        供应用层使用
+ * @brief 主动关闭的连接双方的FIN都已确认，换成TIME_WAIT记录后释放连接
+ *        记录数达到TCP_TW_MAX时直接释放，不进入TIME_WAIT
  *
  * @param connect
  */
-void tcp_connect_close(tcp_connect_t* connect) {
-    if (connect->state == TCP_ESTABLISHED) {
-        tcp_write_to_buf(connect, &txbuf);
-        tcp_send(&txbuf, connect, tcp_flags_ack_fin);
-        connect->state = TCP_FIN_WAIT_1;
-        return;
+static void tcp_time_wait(tcp_connect_t* connect) {
+    tcp_tw_t* tw = tw_table.num < TCP_TW_MAX ? malloc(sizeof(tcp_tw_t)) : NULL;
+    if (tw != NULL) {
+        memcpy(&tw->key, &connect->key, sizeof(tcp_key_t));
+        tw->hash = connect->hash;
+        tw->snd_nxt = connect->next_seq;
+        tw->rcv_nxt = connect->ack;
+        tw->ts_recent = connect->ts_recent;
+        tw->vlan = connect->vlan;
+        tw->ts_ok = connect->ts_ok;
+        if (tcp_hash_add(&tw_table, tw, tw->hash) == 0) {
+            tcp_tw_link(tw);
+            stats_inc(STATS_TCP_TIME_WAIT);
+        } else {
+            free(tw);
+            tw = NULL;
+        }
     }
-    tcp_key_t key = new_tcp_key(connect->ip, connect->remote_port, connect->local_port);
+    if (tw == NULL)
+        stats_inc(STATS_TCP_TW_OVERFLOW);
     release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
 }
 
 /**
- * @brief 从 connect 中读取数据到 buf，返回成功的字节数。
- *        供应用层使用
+ * @brief 在TIME_WAIT中重发最后的ACK，在栈上构造临时连接，通告零窗口
  *
- * @param connect
- * @param data
- * @param len
- * @return size_t
+ * @param tw
  */
-size_t tcp_connect_read(tcp_connect_t* connect, uint8_t* data, size_t len) {
-    buf_t* rx_buf = connect->rx_buf;
-    size_t size = min32(rx_buf->len, len);
-    memcpy(data, rx_buf->data, size);
-    if (buf_remove_header(rx_buf, size) != 0) {
-        memmove(rx_buf->payload, rx_buf->data, rx_buf->len);
-        rx_buf->data = rx_buf->payload;
-    }
-    return size;
+static void tcp_tw_ack(const tcp_tw_t* tw) {
+    tcp_connect_t connect = CONNECT_LISTEN;
+    connect.state = TCP_TIME_WAIT;
+    connect.local_port = tw->key.dst_port;
+    connect.remote_port = tw->key.src_port;
+    memcpy(connect.ip, tw->key.ip, NET_IP6_LEN);
+    connect.version = tw->key.version;
+    connect.vlan = tw->vlan;
+    connect.next_seq = tw->snd_nxt;
+    connect.ack = tw->rcv_nxt;
+    connect.rcv_adv = tw->rcv_nxt;
+    connect.ts_ok = tw->ts_ok;
+    connect.ts_recent = tw->ts_recent;
+    buf_init(&txbuf, 0);
+    tcp_send(&txbuf, &connect, tcp_flags_ack);
 }
 
 /**
- * @brief 往connect的tx_buf里面写东西，返回成功的字节数，这里要判断窗口够不够，否则图片显示不全。
- *        供应用层使用
+ * @brief TIME_WAIT中收到报文段：
+ *        RST忽略，防止TIME_WAIT被提前结束（RFC 1337）；
+ *        序号或时间戳比旧连接新的SYN复用这个四元组，删除记录，初始序号取在旧连接之后（RFC 6191）；
+ *        其余的SYN、重传的FIN和数据回复ACK，重传的FIN说明对端没有收到最后的ACK，TIME_WAIT重新计时
  *
- * @param connect
- * @param data
- * @param len
+ * @param tw
+ * @param flags
+ * @param seq_num 序号
+ * @param len 数据长度
+ * @param opts 选项
+ * @param iss 复用时写入新连接的初始序号
+ * @return int 复用时为0，调用者按监听端口处理这个SYN；否则已经处理完，为-1
  */
-size_t tcp_connect_write(tcp_connect_t* connect, const uint8_t* data, size_t len) {
-    // printf("tcp_connect_write size: %zu\n", len);
-    buf_t* tx_buf = connect->tx_buf;
-
-    uint8_t* dst = tx_buf->data + tx_buf->len;
-    size_t size = min32(&tx_buf->payload[BUF_MAX_LEN] - dst, len);
-
-    if (connect->next_seq - connect->unack_seq + len >= connect->remote_win) {
-        return 0;
-    }
-    if (buf_add_padding(tx_buf, size) != 0) {
-        memmove(tx_buf->payload, tx_buf->data, tx_buf->len);
-        tx_buf->data = tx_buf->payload;
-        if (tcp_write_to_buf(connect, &txbuf)) {
-            tcp_send(&txbuf, connect, tcp_flags_ack);
+static int tcp_tw_in(tcp_tw_t* tw, tcp_flags_t flags, uint32_t seq_num, size_t len, const tcp_opts_t* opts,
+                     uint32_t* iss) {
+    if (flags.rst)
+        return -1;
+    if (flags.syn && !flags.ack) {
+        if (tw->ts_ok && opts->ts_ok ? TCP_SEQ_LT(tw->ts_recent, opts->tsval) : TCP_SEQ_LT(tw->rcv_nxt, seq_num)) {
+            *iss = tw->snd_nxt + UINT16_MAX + 2;
+            stats_inc(STATS_TCP_TW_REUSE);
+            tcp_tw_free(tw);
+            return 0;
         }
-        return 0;
+        tcp_tw_ack(tw);
+        return -1;
     }
-    memcpy(dst, data, size);
-    return size;
+    if (flags.fin) {
+        tcp_tw_unlink(tw);
+        tcp_tw_link(tw);
+    }
+    if (flags.fin || len > 0)
+        tcp_tw_ack(tw);
+    return -1;
 }
 
 /**
- * @brief 服务器端TCP收包
+ * @brief 服务器端TCP收包，ipv4与ipv6共用
  *
  * @param buf
  * @param src_ip
+ * @param version
  */
-void tcp_in(buf_t* buf, uint8_t* src_ip) {
+static void tcp_in_version(buf_t* buf, uint8_t* src_ip, uint8_t version) {
+    LATENCY_MARK(LATENCY_STAGE_IP);
     // printf("I'm in tcp_in00\n");
 
     /*
     1、大小检查，检查buf长度是否小于tcp头部，如果是，则丢弃
     */
 
-    if(buf->len < sizeof(tcp_hdr_t))
+    if(buf->len < sizeof(tcp_hdr_t)) {
+        stats_inc(STATS_TCP_DROP_SHORT);
         return;
+    }
+    stats_inc(STATS_TCP_RX);
     // printf("I'm in tcp_in01\n");
     /*
     2、检查checksum字段，如果checksum出错，则丢弃
@@ -297,10 +2099,26 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     uint16_t checksum = tcp_hdr->chunksum16;
     tcp_hdr->chunksum16 = 0;
 
-    if(checksum != tcp_checksum(buf, src_ip, net_if_ip))
+    uint8_t* dst_ip = net_if_ip;
+    if(version == IP_VERSION_6) {
+        // 目的地址取自buf->data之前仍保留的ipv6头部
+        dst_ip = ((ipv6_hdr_t*)(buf->data - sizeof(ipv6_hdr_t)))->dst_ip;
+        if(ipv6_is_multicast(dst_ip)) {
+            stats_inc(STATS_TCP_DROP_MULTICAST); // TCP只有单播
+            return;
+        }
+    }
+    if(checksum != tcp_checksum(buf, src_ip, dst_ip, version)) {
+        stats_inc(STATS_TCP_DROP_CHECKSUM);
         return;
+    }
     // printf("I'm in tcp_in02\n");
     tcp_hdr->chunksum16 = checksum;
+    size_t hdr_len = tcp_hdr->data_offset * sizeof(uint32_t);
+    if(hdr_len < sizeof(tcp_hdr_t) || hdr_len > buf->len) {
+        stats_inc(STATS_TCP_DROP_SHORT);
+        return;
+    }
 
     /*
     3、从tcp头部字段中获取source port、destination port、
@@ -312,108 +2130,270 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     uint32_t seq_num  = swap32(tcp_hdr->seq_number32);
     uint32_t ack_num  = swap32(tcp_hdr->ack_number32);
     tcp_flags_t flags = tcp_hdr->flags;
+    tcp_opts_t opts;
+    tcp_parse_options(&opts, tcp_hdr, hdr_len);
 
     /*
-    4、调用map_get函数，根据destination port查找对应的handler函数
+    4、调用new_tcp_key函数，根据源IP地址、目标IP地址、源端口号、目标端口号确定一个tcp链接key，并算出它的哈希值
     */
 
-    tcp_handler_t* handler = map_get(&tcp_table, &dst_port);
-    if(handler == NULL)
-        return;
-    // printf("I'm in tcp_in03\n");
+    tcp_key_t key = new_tcp_key(src_ip, dst_ip, version, src_port, dst_port);
+    uint32_t hash = tcp_key_hash(&key);
+
     /*
-    5、调用new_tcp_key函数，根据通信五元组中的源IP地址、目标IP地址、目标端口号确定一个tcp链接key
+    5、调用tcp_hash_get函数，根据key查找一个tcp_connect_t* connect，已有的连接使用自己的handler（主动打开的连接没有监听端口），
+    没有连接时再查找TIME_WAIT记录，由tcp_tw_in处理，只有复用四元组的SYN继续往下走；
+    否则根据destination port查找监听端口
     */
 
-    tcp_key_t key = new_tcp_key(src_ip, src_port, dst_port);
+    tcp_connect_t* connect = tcp_hash_get(&connect_table, &key, hash);
+    uint32_t tw_iss = 0; // 复用TIME_WAIT记录时新连接的初始序号，0表示随机选取
+    if(connect == NULL) {
+        tcp_tw_t* tw = tcp_hash_get(&tw_table, &key, hash);
+        if(tw != NULL && tcp_tw_in(tw, flags, seq_num, buf->len - hdr_len, &opts, &tw_iss) != 0)
+            return;
+    }
+    tcp_listener_t* listener = NULL;
+    tcp_handler_t handler;
+    if(connect != NULL) {
+        handler = connect->handler;
+    } else {
+        listener = map_get(&tcp_table, &dst_port);
+        if(listener == NULL) {
+            stats_inc(STATS_TCP_DROP_PORT);
+            return;
+        }
+        handler = listener->handler;
+    }
+    // printf("I'm in tcp_in03\n");
 
     /*
-    6、调用map_get函数，根据key查找一个tcp_connect_t* connect，
-    如果没有找到，则调用map_set建立新的链接，并设置为CONNECT_LISTEN状态，然后调用mag_get获取到该链接。
+    6、没有找到连接时先用栈上的CONNECT_LISTEN处理，三次握手完成后才在connect_table中建立连接
     */
 
-    tcp_connect_t* connect = map_get(&connect_table, &key);
-    if(connect == NULL) {
-        // printf("I'm in tcp_in04\n");
-        tcp_connect_t* new_connect = (tcp_connect_t* )malloc(sizeof(tcp_connect_t));
-        *new_connect = CONNECT_LISTEN;
-        map_set(&connect_table, &key, new_connect);
-
-        connect = map_get(&connect_table, &key);
-    }
+    tcp_connect_t listen_connect = CONNECT_LISTEN;
+    if(listener != NULL)
+        connect = &listen_connect;
     // printf("I'm in tcp_in05\n");
 
     /*
-    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换
+    7、从TCP头部字段中获取对方的窗口大小，注意大小端转换，SYN以外的报文段按协商的因子扩大
     */
 
-    uint16_t window_size = swap16(tcp_hdr->window_size16);
+    uint32_t window_size = swap16(tcp_hdr->window_size16);
+    if(!flags.syn)
+        window_size <<= connect->snd_wscale;
 
     /*
     8、如果为TCP_LISTEN状态，则需要完成如下功能：
-        （1）如果收到的flag带有rst，则close_tcp关闭tcp链接
-        （2）如果收到的flag不是syn，则reset_tcp复位通知。因为收到的第一个包必须是syn
-        （3）调用init_tcp_connect_rcvd函数，初始化connect，将状态设为TCP_SYN_RCVD
-        （4）填充connect字段，包括
-            local_port、remote_port、ip、
-            unack_seq（设为随机值）、由于是对syn的ack应答包，next_seq与unack_seq一致
-            ack设为对方的sequence number+1
-            设置remote_win为对方的窗口大小，注意大小端转换
-        （5）调用buf_init初始化txbuf
-        （6）调用tcp_send将txbuf发送出去，也就是回复一个tcp_flags_ack_syn（SYN+ACK）报文
-        （7）处理结束，返回。
+        （1）如果收到的flag带有rst，序号正确时删除对应的半连接
+        （2）如果收到的是syn：
+            重复的syn重传SYN+ACK；
+            否则调用tcp_syn_queue放入半连接队列并回复SYN+ACK，不分配缓存；
+            队列已满时回复以SYN cookie为序号的SYN+ACK，不保存任何状态
+        （3）如果收到的是ack，确认号必须正好确认半连接或SYN cookie的SYN，否则reset_tcp复位通知；
+            只在最近发出过cookie时（TCP_SYN_COOKIE_WINDOW_MS以内）才校验cookie
+        （4）监听端口的全连接队列已满时丢弃这个ack，半连接保留，等对端重传
+        （5）调用tcp_connect_new在connect_table中建立连接并挂到监听端口上，调用init_tcp_connect_rcvd分配缓存，
+            再调用tcp_syn_fill用半连接或cookie中的信息填充连接，状态为TCP_SYN_RCVD，
+            然后按TCP_SYN_RCVD状态继续处理这个ack
     */
 
     if(connect->state == TCP_LISTEN) {
         // printf("I'm in tcp_in06\n");
-        if(flags.rst) 
-            goto close_tcp;
-        else if(!flags.syn)
-            goto reset_tcp;
-        else {
+        tcp_syn_t* syn = tcp_hash_get(&syn_table, &key, hash);
+        if(flags.rst) {
+            if(syn != NULL && seq_num == syn->irs + 1)
+                tcp_syn_drop(syn);
+            return;
+        }
+        if(flags.syn) {
             // printf("I'm in tcp_in07\n");
-            init_tcp_connect_rcvd(connect);
-
-            connect->local_port = dst_port;
-            connect->remote_port = src_port;
-            memcpy(connect->ip, src_ip, NET_IP_LEN);
+            if(syn != NULL) {
+                if(seq_num == syn->irs)
+                    tcp_syn_ack_send(&key, syn->vlan, syn->iss, syn->irs, syn->remote_win, &syn->opts);
+                return;
+            }
+            if(tcp_syn_queue(listener, &key, hash, tw_iss ? tw_iss : tcp_iss_new(), seq_num, window_size, &opts) == 0)
+                return;
+            // 半连接队列已满，SYN cookie只能保留MSS，其余选项不启用
+            tcp_opts_t cookie_opts = {
+                .mss = opts.mss ? opts.mss : (version == IP_VERSION_6 ? TCP_DEFAULT_MSS6 : TCP_DEFAULT_MSS),
+            };
+            uint32_t cookie = tcp_cookie_make(&key, seq_num, &cookie_opts.mss);
+            listener->cookie_sent = timer_now();
+            stats_inc(STATS_TCP_SYN_COOKIE);
+            tcp_syn_ack_send(&key, net_if_vlan, cookie, seq_num, window_size, &cookie_opts);
+            return;
+        }
+        if(!flags.ack)
+            goto reset_tcp;
 
-            srand(time(NULL) + dst_port);
-            connect->unack_seq = rand() % UINT16_MAX; // need to be smaller
-            connect->next_seq = connect->unack_seq;
-            connect->ack = seq_num + 1;
+        // 只在半连接队列真正溢出过的一段时间内校验cookie，平时不给猜测cookie的ACK建立连接的机会
+        int cookie_live = syn == NULL && listener->cookie_sent
+                          && timer_now() - listener->cookie_sent < TCP_SYN_COOKIE_WINDOW_MS;
+        tcp_syn_t entry;
+        if(syn != NULL && ack_num == syn->iss + 1) {
+            entry = *syn;
+        } else if(cookie_live && tcp_cookie_check(&key, seq_num - 1, ack_num - 1, &entry.opts.mss) == 0) {
+            uint16_t mss = entry.opts.mss;
+            memset(&entry.opts, 0, sizeof(entry.opts));
+            entry.opts.mss = mss;
+            entry.iss = ack_num - 1;
+            entry.irs = seq_num - 1;
+            entry.remote_win = swap16(tcp_hdr->window_size16);
+            entry.vlan = net_if_vlan;
+            entry.retries = 1; // 不知道SYN+ACK的发送时间，不测量往返时间
+            stats_inc(STATS_TCP_SYN_COOKIE_OK);
+        } else {
+            if(cookie_live)
+                stats_inc(STATS_TCP_SYN_COOKIE_BAD);
+            goto reset_tcp;
+        }
+        if(listener->backlog && listener->accept_head - listener->accept_tail >= listener->backlog) {
+            stats_inc(STATS_TCP_ACCEPT_OVERFLOW);
+            listener->overflows++;
+            return; // 全连接队列已满，丢弃后等对端重传，半连接保留
+        }
+        connect = tcp_connect_new(&key, listener);
+        if(connect == NULL)
+            return; // 内存不足，丢弃后等对端重传
+        if(init_tcp_connect_rcvd(connect) != 0) {
+            tcp_connect_unlink(connect);
+            free(connect);
+            return; // 缓存分配失败，同样丢弃
+        }
+        tcp_syn_fill(connect, &key, entry.vlan, entry.iss, entry.irs, entry.remote_win, &entry.opts);
+        connect->handler = handler;
+        tcp_cc_reset(connect);
+        if(entry.retries == 0) {
+            connect->rtt_seq = entry.iss + 1;
+            connect->rtt_start = entry.sent;
+        }
+        if(syn != NULL)
+            tcp_syn_drop(syn);
+        window_size = (uint32_t)swap16(tcp_hdr->window_size16) << connect->snd_wscale;
+    }
+    // printf("I'm in tcp_in08\n");
 
-            connect->remote_win = window_size;
+    /*
+    TCP_SYN_SEND状态（主动打开）：
+        （1）确认号不是正好确认SYN时丢弃，不带rst时用该确认号作序号复位对端
+        （2）确认了SYN的rst表示连接被拒绝，调用handler进入TCP_CONN_CLOSED状态后close_tcp
+        （3）收到SYN+ACK：协商选项，处理确认，转为ESTABLISHED，调用handler进入TCP_CONN_CONNECTED状态，
+            再调用tcp_output完成第三次握手
+        （4）只收到SYN是双方同时打开，转为TCP_SYN_RCVD并重新发出带ACK的SYN
+    */
 
+    if(connect->state == TCP_SYN_SEND) {
+        if(flags.ack && ack_num != connect->unack_seq + 1) {
+            if(!flags.rst) {
+                uint32_t next_seq = connect->next_seq;
+                connect->next_seq = ack_num;
+                buf_init(&txbuf, 0);
+                tcp_send(&txbuf, connect, tcp_flags_rst);
+                connect->next_seq = next_seq;
+            }
+            return;
+        }
+        if(flags.rst) {
+            if(!flags.ack)
+                return;
+            stats_inc(STATS_TCP_RESET);
+            tcp_notify_closed(connect);
+            goto close_tcp;
+        }
+        if(!flags.syn)
+            return;
+        connect->ack = seq_num + 1;
+        connect->rcv_adv = connect->ack;
+        connect->remote_win = window_size;
+        tcp_negotiate(connect, &opts);
+        tcp_cc_reset(connect); // 保留应用层在握手前选择的算法
+        if(flags.ack) {
+            tcp_ack(connect, ack_num, 0, &opts);
+            connect->state = TCP_ESTABLISHED;
+            event_post(&connect->event, EVENT_WRITABLE);
+            tcp_notify(connect, handler, TCP_CONN_CONNECTED);
+            tcp_output(connect, 1);
+        } else {
+            connect->state = TCP_SYN_RCVD;
+            connect->next_seq = connect->unack_seq;
             buf_init(&txbuf, 0);
             tcp_send(&txbuf, connect, tcp_flags_ack_syn);
         }
-
         return;
     }
-    // printf("I'm in tcp_in08\n");
 
-    /* 
-    9、检查接收到的sequence number，如果与ack序号不一致,则reset_tcp复位通知。
+    /*
+    9、检查flags是否有rst标志，序号正好是期望的序号时才接受，防止伪造的RST
+    */
+
+    if(flags.rst) {
+        if(seq_num != connect->ack)
+            return;
+        tcp_notify_closed(connect);
+        goto close_tcp;
+    }
+
+    /*
+    10、SYN_RCVD状态下重复的SYN说明对端没有收到SYN+ACK，立即重传
     */
 
-    if(seq_num != connect->ack)
-        goto reset_tcp;
+    if(flags.syn) {
+        if(connect->state == TCP_SYN_RCVD && seq_num + 1 == connect->ack)
+            tcp_rtx_timeout(connect);
+        return;
+    }
     // printf("I'm in tcp_in09\n");
-    /* 
-    10、检查flags是否有rst标志，如果有，则close_tcp连接重置
+
+    /*
+    PAWS：时间戳比最近收到的还旧，是上一个序号周期的旧报文段，回复ACK后丢弃（RFC 7323）
     */
 
-    if(flags.rst)
-        goto close_tcp;
-    // printf("I'm in tcp_in10\n");
+    if(connect->ts_ok && opts.ts_ok) {
+        if(TCP_SEQ_LT(opts.tsval, connect->ts_recent)) {
+            buf_init(&txbuf, 0);
+            tcp_send(&txbuf, connect, tcp_flags_ack);
+            return;
+        }
+        if(TCP_SEQ_LEQ(seq_num, connect->ack_sent))
+            connect->ts_recent = opts.tsval;
+    }
+
     /*
-    11、序号相同时的处理，调用buf_remove_header去除头部后剩下的都是数据
+    11、去除头部后剩下的都是数据，调用tcp_read_from_buf函数放入rx_buf中，乱序的数据先放入乱序队列。
+        报文段不是正好接在已收到的数据之后（重复、乱序或补齐了空缺）时立即回复ACK，
+        乱序时就是重复ACK，让对端尽快重传；没有收下任何新数据的报文段也立即回复ACK：
+        正好结束在已收到处的重复报文段多半是我方的ACK丢了，对端超时重传；接收缓存已满时的数据；
+        以及对端的保活探测，它的序号在已收到的数据之前，不带数据或带一个字节的垃圾数据。
+        FIN之前还有没收到的数据时先不处理FIN，等对端重传。
+        对端窗口打开时产生可写事件，收到新的按序数据或FIN时产生可读事件。
+        收到报文段说明对端还在，重新计算保活的空闲时间
     */
 
-    buf_remove_header(buf, sizeof(tcp_hdr_t));
+    connect->rx_stamp = timer_now();
+    connect->ka_sent = 0;
+    buf_remove_header(buf, hdr_len);
+    int dup_ack = buf->len == 0 && !flags.fin && window_size == connect->remote_win;
+    uint32_t rcv_nxt = connect->ack;
+    if(window_size > connect->remote_win && connect->state == TCP_ESTABLISHED)
+        event_post(&connect->event, EVENT_WRITABLE);
+    connect->remote_win = window_size;
+    size_t recv_len = tcp_read_from_buf(connect, buf, seq_num);
+    if(buf->len > connect->rcv_mss)
+        connect->rcv_mss = buf->len;
+    int stale = recv_len == 0 && !flags.fin && (buf->len > 0 || TCP_SEQ_LT(seq_num, rcv_nxt));
+    if(((buf->len > 0 || flags.fin) && seq_num + buf->len != connect->ack) || stale) {
+        flags.fin = 0;
+        buf_init(&txbuf, 0);
+        tcp_send(&txbuf, connect, tcp_flags_ack);
+    }
+    if(recv_len > 0 || flags.fin)
+        event_post(&connect->event, EVENT_READABLE);
+    // printf("I'm in tcp_in10\n");
 
-    /* 
+    /*
     状态转换
     */
     switch (connect->state) {
@@ -434,16 +2414,26 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
 
         /*
         13、如果是ack包，需要完成如下功能：
-            （1）将unack_seq +1
+            （1）确认号必须正好确认SYN，否则复位
             （2）将状态转成ESTABLISHED
-            （3）调用回调函数，完成三次握手，进入连接状态TCP_CONN_CONNECTED。
+            （3）完成三次握手：监听端口有全连接队列时放入队列等待tcp_accept，否则调用回调函数，进入连接状态TCP_CONN_CONNECTED。
+            （4）第三次握手可能携带数据，继续按ESTABLISHED处理
         */
         // printf("I'm in tcp_in12\n");
-        connect->unack_seq++;
+        if(ack_num != connect->unack_seq + 1)
+            goto reset_tcp;
+        tcp_ack(connect, ack_num, dup_ack, &opts);
         connect->state = TCP_ESTABLISHED;
-        (*handler)(connect, TCP_CONN_CONNECTED);
-        break;
-
+        if(listener != NULL && listener->backlog) {
+            listener->accept_queue[listener->accept_head++ % TCP_ACCEPT_BACKLOG_MAX] = connect;
+            connect->accepting = 1;
+            event_post(&listener->event, EVENT_READABLE);
+        } else {
+            tcp_notify(connect, handler, TCP_CONN_CONNECTED);
+        }
+        if(connect->state != TCP_ESTABLISHED)
+            break;
+        // fall through
 
     case TCP_ESTABLISHED:
 
@@ -456,54 +2446,42 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
             break;
 
         /*
-        15、这里先处理ACK的值，
-            如果是ack包，
-            且unack_seq小于ack number（说明有部分数据被对端接收确认了，否则可能是之前重发的ack，可以不处理），
-            且next_seq大于ack number // why?
-            则调用buf_remove_header函数，去掉被对端接收确认的部分数据，并更新unack_seq值
-            
+        15、这里先处理ACK的值，释放被对端确认的数据，更新往返时间与重传定时器
         */
 
         if(flags.ack) {
             // printf("I'm in tcp_in14\n");
-            if(connect->unack_seq < ack_num && connect->next_seq > ack_num) {
-                // printf("I'm in tcp_in15\n");
-                buf_remove_header(connect->tx_buf, ack_num - connect->unack_seq);
-                connect->unack_seq = ack_num;
-            }
+            tcp_ack(connect, ack_num, dup_ack, &opts);
         }
 
         /*
-        16、然后接收数据
-            调用tcp_read_from_buf函数，把buf放入rx_buf中
+        16、数据已经在第11步放入rx_buf中，recv_len为新增的按序数据
         */
         // printf("I'm in tcp_in16\n");
-        tcp_read_from_buf(connect, buf);
 
         /*
         17、再然后，根据当前的标志位进一步处理
-            （1）首先调用buf_init初始化txbuf
-            （2）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，再发送一个ACK + FIN包，并退出，
+            （1）判断是否收到关闭请求（FIN），如果是，将状态改为TCP_LAST_ACK，ack +1，发完剩余数据后带上FIN，
                 这样就无需进入CLOSE_WAIT，直接等待对方的ACK
-            （3）如果不是FIN，则看看是否有数据，如果有，则发ACK相应，并调用handler回调函数进行处理
-            （4）调用tcp_write_to_buf函数，看看是否有数据需要发送，如果有，同时发数据和ACK
-            （5）没有收到数据，可能对方只发一个ACK，可以不响应
-
+            （2）如果不是FIN，则看看是否有数据，如果有，则调用handler回调函数进行处理
+            （3）调用tcp_output，发送窗口内的数据，数据捎带对收到数据的确认
+            （4）没有捎带出去的确认交给tcp_ack_schedule：FIN和PSH在本批收包处理完后确认，
+                否则每两个满长报文段确认一次，不足时延迟确认
+            （5）没有收到数据，可能对方只发一个ACK，只补发窗口打开后可发的数据
         */
         // printf("I'm in tcp_in17\n");
-        buf_init(&txbuf, 0);
         if(flags.fin) {
             // printf("I'm in tcp_in18\n");
             connect->state = TCP_LAST_ACK;
             connect->ack++;
-            tcp_send(&txbuf, connect, tcp_flags_ack_fin);
         }
-        else if(buf->len > 0){
+        else if(recv_len > 0){
             // printf("I'm in tcp_in19\n");
-            (*handler)(connect, TCP_CONN_DATA_RECV);
-            tcp_write_to_buf(connect, &txbuf);
-            tcp_send(&txbuf, connect, tcp_flags_ack);
+            tcp_notify(connect, handler, TCP_CONN_DATA_RECV);
         }
+        tcp_output(connect, 0);
+        if(recv_len > 0 || flags.fin)
+            tcp_ack_schedule(connect, flags.fin || flags.psh);
 
         break;
 
@@ -515,43 +2493,81 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     case TCP_FIN_WAIT_1:
 
         /*
-        18、如果收到FIN && ACK，则close_tcp直接关闭TCP
-            如果只收到ACK，则将状态转为TCP_FIN_WAIT_2
+        18、处理确认号，FIN被确认则转为TCP_FIN_WAIT_2并改用保活定时器计FIN_WAIT_2超时，否则补发数据和FIN
+            对端在半关闭状态下仍可能发来数据，照常接收并按tcp_ack_schedule确认
+            如果同时收到FIN：FIN已被确认则回复ACK后调用tcp_time_wait进入TIME_WAIT，否则转为TCP_CLOSING
         */
 
         // printf("I'm in tcp_in21\n");
-        if(flags.fin && flags.ack)
-            goto close_tcp;
         if(flags.ack)
+            tcp_ack(connect, ack_num, dup_ack, &opts);
+        if(flags.fin) {
+            connect->ack++;
+            if(connect->fin_acked) {
+                buf_init(&txbuf, 0);
+                tcp_send(&txbuf, connect, tcp_flags_ack);
+                tcp_time_wait(connect);
+                return;
+            }
+            connect->state = TCP_CLOSING;
+        }
+        else if(connect->fin_acked) {
             connect->state = TCP_FIN_WAIT_2;
-        
+            timer_cancel(&connect->ka_timer);
+            timer_add(&connect->ka_timer, TCP_FIN_WAIT2_MS);
+        }
+        tcp_output(connect, flags.fin);
+        if(recv_len > 0)
+            tcp_ack_schedule(connect, flags.psh);
+
         break;
 
     case TCP_FIN_WAIT_2:
         /*
-        19、如果不是FIN，则不做处理
-            如果是，则将ACK +1，调用buf_init初始化txbuf，调用tcp_send发送一个ACK数据包，再close_tcp关闭TCP
+        19、对端剩余的数据已在第11步接收，有新数据则按tcp_ack_schedule确认；收到FIN则将ACK +1，发送一个ACK数据包，再调用tcp_time_wait进入TIME_WAIT
         */
         // printf("I'm in tcp_in22\n");
         if(flags.fin) {
             connect->ack++;
             buf_init(&txbuf, 0);
             tcp_send(&txbuf, connect, tcp_flags_ack);
-            goto close_tcp;
+            tcp_time_wait(connect);
+            return;
+        }
+        if(recv_len > 0)
+            tcp_ack_schedule(connect, flags.psh);
+
+        break;
+
+    case TCP_CLOSING:
+        /*
+        20、双方同时关闭，对端确认我方的FIN后进入TIME_WAIT
+        */
+        if(flags.ack)
+            tcp_ack(connect, ack_num, dup_ack, &opts);
+        if(connect->fin_acked) {
+            tcp_time_wait(connect);
+            return;
         }
+        tcp_output(connect, 0);
 
         break;
 
     case TCP_LAST_ACK:
         /*
-        20、如果不是ACK，则不做处理
-            如果是，则调用handler函数，进入TCP_CONN_CLOSED状态，，再close_tcp关闭TCP
+        21、处理确认号，FIN被确认则调用handler函数，进入TCP_CONN_CLOSED状态，再close_tcp关闭TCP
+            否则补发剩余的数据和FIN
         */
 
-        if(flags.ack) {
-            (*handler)(connect, TCP_CONN_CLOSED);
+        if(flags.ack)
+            tcp_ack(connect, ack_num, dup_ack, &opts);
+        if(connect->fin_acked) {
+            tcp_notify_closed(connect);
             goto close_tcp;
         }
+        tcp_output(connect, 0);
+
+        break;
 
     default:
         panic("connect->state", __LINE__);
@@ -560,13 +2576,38 @@ void tcp_in(buf_t* buf, uint8_t* src_ip) {
     return;
 
 reset_tcp:
-    printf("!!! reset tcp !!!\n");
+    stats_inc(STATS_TCP_RESET);
+    LOG_INFO(LOG_EVENT_TCP_RESET, key.ip, version == IP_VERSION_6 ? NET_IP6_LEN : NET_IP_LEN, dst_port, src_port, 0);
+    connect->local_port = dst_port;
+    connect->remote_port = src_port;
+    memcpy(connect->ip, key.ip, NET_IP6_LEN);
+    connect->version = version;
+    connect->vlan = net_if_vlan;
     connect->next_seq = 0;
     connect->ack = seq_num + 1;
     buf_init(&txbuf, 0);
     tcp_send(&txbuf, connect, tcp_flags_ack_rst);
 close_tcp:
     release_tcp_connect(connect);
-    map_delete(&connect_table, &key);
     return;
 }
+
+/**
+ * @brief ipv4上的TCP收包
+ *
+ * @param buf
+ * @param src_ip
+ */
+void tcp_in(buf_t* buf, uint8_t* src_ip) {
+    tcp_in_version(buf, src_ip, IP_VERSION_4);
+}
+
+/**
+ * @brief ipv6上的TCP收包
+ *
+ * @param buf
+ * @param src_ip
+ */
+void tcp6_in(buf_t* buf, uint8_t* src_ip) {
+    tcp_in_version(buf, src_ip, IP_VERSION_6);
+}
@@ -0,0 +1,202 @@
+#include "tcp.h"
+
+#define CUBIC_C 0.4    // CUBIC的缩放常数
+#define CUBIC_BETA 0.7 // CUBIC检测到丢包后窗口的缩小比例
+
+/**
+ * @brief 正在传输中的字节数
+ *
+ * @param connect
+ * @return uint32_t 字节数
+ */
+static uint32_t tcp_cc_flight(tcp_connect_t* connect) {
+    return connect->max_seq - connect->unack_seq;
+}
+
+/**
+ * @brief 慢启动，每确认一个报文段的数据cwnd最多增加一个MSS（RFC 3465，L=1）
+ *
+ * @param connect
+ * @param acked 新确认的字节数
+ */
+static void tcp_cc_slow_start(tcp_connect_t* connect, uint32_t acked) {
+    connect->cwnd += min32(acked, tcp_mss(connect));
+}
+
+/**
+ * @brief 快速恢复中的重复ACK表示又有一个报文段离开了网络，窗口膨胀一个MSS
+ *
+ * @param connect
+ */
+static void tcp_cc_inflate(tcp_connect_t* connect) {
+    connect->cwnd += tcp_mss(connect);
+}
+
+static void newreno_init(tcp_connect_t* connect) {
+}
+
+/**
+ * @brief NewReno收到确认：慢启动阶段指数增长，拥塞避免阶段每个往返时间增长约一个MSS
+ *
+ * @param connect
+ * @param acked 新确认的字节数
+ */
+static void newreno_ack(tcp_connect_t* connect, uint32_t acked) {
+    if (connect->cwnd < connect->ssthresh) {
+        tcp_cc_slow_start(connect, acked);
+        return;
+    }
+    uint32_t mss = tcp_mss(connect);
+    uint32_t inc = (uint64_t)mss * mss / connect->cwnd;
+    connect->cwnd += inc ? inc : 1;
+}
+
+/**
+ * @brief NewReno检测到丢包：ssthresh取在途数据的一半（RFC 5681）
+ *
+ * @param connect
+ */
+static void newreno_loss(tcp_connect_t* connect) {
+    uint32_t mss = tcp_mss(connect);
+    uint32_t half = tcp_cc_flight(connect) / 2;
+    connect->ssthresh = half > 2 * mss ? half : 2 * mss;
+}
+
+/**
+ * @brief NewReno重传超时：只有第一次超时重新计算ssthresh，窗口回到一个MSS
+ *
+ * @param connect
+ */
+static void newreno_rto(tcp_connect_t* connect) {
+    if (connect->retries == 1)
+        newreno_loss(connect);
+    connect->cwnd = tcp_mss(connect);
+}
+
+/**
+ * @brief 牛顿迭代求立方根，避免依赖libm
+ *
+ * @param x 非负数
+ * @return double 立方根
+ */
+static double cubic_cbrt(double x) {
+    if (x <= 0)
+        return 0;
+    double r = x < 1 ? 1 : x;
+    for (int i = 0; i < 64; i++) {
+        double next = r - (r * r * r - x) / (3 * r * r);
+        if (r - next < 1e-9 && next - r < 1e-9)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+static void cubic_init(tcp_connect_t* connect) {
+    connect->cubic.w_max = 0;
+    connect->cubic.w_est = 0;
+    connect->cubic.epoch_start = 0;
+    connect->cubic.k = 0;
+}
+
+/**
+ * @brief CUBIC收到确认：拥塞避免阶段窗口按 W(t) = C*(t-K)^3 + W_max 增长，
+ *        低于Reno估计值时取Reno估计值（RFC 9438）
+ *
+ * @param connect
+ * @param acked 新确认的字节数
+ */
+static void cubic_ack(tcp_connect_t* connect, uint32_t acked) {
+    if (connect->cwnd < connect->ssthresh) {
+        tcp_cc_slow_start(connect, acked);
+        return;
+    }
+    tcp_cubic_t* cubic = &connect->cubic;
+    uint32_t mss = tcp_mss(connect);
+    uint64_t now = timer_now();
+    if (cubic->epoch_start == 0) {
+        cubic->epoch_start = now;
+        if (cubic->w_max > connect->cwnd) {
+            cubic->k = cubic_cbrt((double)(cubic->w_max - connect->cwnd) / mss / CUBIC_C);
+        } else {
+            cubic->k = 0;
+            cubic->w_max = connect->cwnd;
+        }
+        cubic->w_est = connect->cwnd;
+    }
+
+    // 目标取一个往返时间之后的窗口
+    double t = (double)(now - cubic->epoch_start + connect->srtt) / 1000 - cubic->k;
+    double target = cubic->w_max + CUBIC_C * t * t * t * mss;
+    if (target < connect->cwnd)
+        target = connect->cwnd;
+    else if (target > connect->cwnd * 1.5)
+        target = connect->cwnd * 1.5;
+
+    cubic->w_est += (uint64_t)acked * mss * 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) / connect->cwnd;
+    if (cubic->w_est > target)
+        target = cubic->w_est;
+
+    uint32_t inc = (target - connect->cwnd) * acked / connect->cwnd;
+    connect->cwnd += inc;
+}
+
+/**
+ * @brief CUBIC检测到丢包：记录W_max（带快速收敛），窗口乘以beta
+ *
+ * @param connect
+ */
+static void cubic_loss(tcp_connect_t* connect) {
+    tcp_cubic_t* cubic = &connect->cubic;
+    uint32_t mss = tcp_mss(connect);
+    if (connect->cwnd < cubic->w_max)
+        cubic->w_max = connect->cwnd * (1 + CUBIC_BETA) / 2; // 快速收敛，给新的流让出带宽
+    else
+        cubic->w_max = connect->cwnd;
+    cubic->epoch_start = 0;
+    uint32_t ssthresh = connect->cwnd * CUBIC_BETA;
+    connect->ssthresh = ssthresh > 2 * mss ? ssthresh : 2 * mss;
+}
+
+/**
+ * @brief CUBIC重传超时：只有第一次超时按丢包处理，窗口回到一个MSS
+ *
+ * @param connect
+ */
+static void cubic_rto(tcp_connect_t* connect) {
+    if (connect->retries == 1)
+        cubic_loss(connect);
+    connect->cubic.epoch_start = 0;
+    connect->cwnd = tcp_mss(connect);
+}
+
+static const tcp_cc_ops_t tcp_cc_table[TCP_CC_NUM] = {
+    [TCP_CC_NEWRENO] = {
+        .name = "newreno",
+        .init = newreno_init,
+        .ack = newreno_ack,
+        .dupack = tcp_cc_inflate,
+        .loss = newreno_loss,
+        .rto = newreno_rto,
+    },
+    [TCP_CC_CUBIC] = {
+        .name = "cubic",
+        .init = cubic_init,
+        .ack = cubic_ack,
+        .dupack = tcp_cc_inflate,
+        .loss = cubic_loss,
+        .rto = cubic_rto,
+    },
+};
+
+/**
+ * @brief 查找拥塞控制算法
+ *
+ * @param cc 算法
+ * @return const tcp_cc_ops_t* 算法的回调，不支持的算法为NULL
+ */
+const tcp_cc_ops_t* tcp_cc_get(tcp_cc_t cc) {
+    if (cc >= TCP_CC_NUM)
+        return NULL;
+    return &tcp_cc_table[cc];
+}
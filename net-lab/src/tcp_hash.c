@@ -0,0 +1,124 @@
+#include "tcp_hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+ * @brief 分配哈希表的槽
+ *
+ * @param table 要初始化的表
+ * @param size 初始容量，必须是2的幂
+ * @param key_offset 键在对象中的偏移
+ * @param key_len 键的长度
+ * @return int 成功为0，失败为-1
+ */
+int tcp_hash_init(tcp_hash_t* table, uint32_t size, size_t key_offset, size_t key_len) {
+    assert(size && (size & (size - 1)) == 0);
+    table->slots = calloc(size, sizeof(tcp_hash_slot_t));
+    if (!table->slots)
+        return -1;
+    table->mask = size - 1;
+    table->num = 0;
+    table->key_offset = key_offset;
+    table->key_len = key_len;
+    return 0;
+}
+
+/**
+ * @brief 按键查找对象
+ *
+ * @param table 表
+ * @param key 键
+ * @param hash 键的哈希值
+ * @return void* 对象，没有找到为NULL
+ */
+void* tcp_hash_get(const tcp_hash_t* table, const void* key, uint32_t hash) {
+    for (uint32_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+        const tcp_hash_slot_t* slot = &table->slots[i];
+        if (!slot->obj)
+            return NULL;
+        if (slot->hash == hash && memcmp((uint8_t*)slot->obj + table->key_offset, key, table->key_len) == 0)
+            return slot->obj;
+    }
+}
+
+/**
+ * @brief 把对象放入探测序列中的第一个空槽
+ *
+ * @param slots 槽
+ * @param mask 容量减一
+ * @param obj 对象
+ * @param hash 对象的哈希值
+ */
+static void tcp_hash_place(tcp_hash_slot_t* slots, uint32_t mask, void* obj, uint32_t hash) {
+    uint32_t i = hash & mask;
+    while (slots[i].obj)
+        i = (i + 1) & mask;
+    slots[i].hash = hash;
+    slots[i].obj = obj;
+}
+
+/**
+ * @brief 容量翻倍并重新放入所有对象
+ *
+ * @param table 表
+ * @return int 成功为0，内存不足为-1
+ */
+static int tcp_hash_grow(tcp_hash_t* table) {
+    uint32_t size = (table->mask + 1) * 2;
+    if (size == 0)
+        return -1;
+    tcp_hash_slot_t* slots = calloc(size, sizeof(tcp_hash_slot_t));
+    if (!slots)
+        return -1;
+    for (uint32_t i = 0; i <= table->mask; i++)
+        if (table->slots[i].obj)
+            tcp_hash_place(slots, size - 1, table->slots[i].obj, table->slots[i].hash);
+    free(table->slots);
+    table->slots = slots;
+    table->mask = size - 1;
+    return 0;
+}
+
+/**
+ * @brief 加入一个对象，调用者保证键不重复
+ *
+ * @param table 表
+ * @param obj 对象
+ * @param hash 对象的键的哈希值
+ * @return int 成功为0，表满且无法扩容为-1
+ */
+int tcp_hash_add(tcp_hash_t* table, void* obj, uint32_t hash) {
+    if ((uint64_t)(table->num + 1) * 4 > (uint64_t)(table->mask + 1) * 3 && tcp_hash_grow(table) != 0 &&
+        table->num == table->mask)
+        return -1; // 扩容失败时还能继续用到只剩一个空槽
+    tcp_hash_place(table->slots, table->mask, obj, hash);
+    table->num++;
+    return 0;
+}
+
+/**
+ * @brief 移除一个对象，把后面探测序列中的对象前移填补空槽
+ *
+ * @param table 表
+ * @param obj 对象
+ * @param hash 对象的键的哈希值
+ */
+void tcp_hash_remove(tcp_hash_t* table, const void* obj, uint32_t hash) {
+    uint32_t i = hash & table->mask;
+    while (table->slots[i].obj != obj) {
+        if (!table->slots[i].obj)
+            return;
+        i = (i + 1) & table->mask;
+    }
+    table->num--;
+    for (uint32_t j = (i + 1) & table->mask; table->slots[j].obj; j = (j + 1) & table->mask) {
+        // 槽j中的对象的理想位置不在(i, j]之间时可以前移到i
+        uint32_t home = table->slots[j].hash & table->mask;
+        if (((j - home) & table->mask) >= ((j - i) & table->mask)) {
+            table->slots[i] = table->slots[j];
+            i = j;
+        }
+    }
+    table->slots[i].obj = NULL;
+}
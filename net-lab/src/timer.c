@@ -0,0 +1,127 @@
+#include <time.h>
+#include "timer.h"
+
+/**
+ * @brief 时间轮，每槽一个带头结点的循环双向链表，槽宽TIMER_TICK_MS毫秒
+ *        超过一圈的定时器留在槽内，到期前轮到时跳过
+ *
+ */
+static net_timer_t timer_wheel[TIMER_WHEEL_SIZE];
+
+/**
+ * @brief 已经处理到的tick
+ *
+ */
+static uint64_t timer_tick;
+
+/**
+ * @brief 取当前单调时钟的毫秒数
+ *
+ * @return uint64_t 毫秒
+ */
+uint64_t timer_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 初始化时间轮
+ *
+ */
+void timer_init()
+{
+    for (int i = 0; i < TIMER_WHEEL_SIZE; i++)
+        timer_wheel[i].prev = timer_wheel[i].next = &timer_wheel[i];
+    timer_tick = timer_now() / TIMER_TICK_MS;
+}
+
+/**
+ * @brief 初始化一个定时器，不会启动它
+ *
+ * @param timer 定时器
+ * @param handler 到期时调用的处理程序
+ * @param arg 处理程序的参数
+ */
+void timer_setup(net_timer_t *timer, net_timer_handler_t handler, void *arg)
+{
+    timer->prev = timer->next = NULL;
+    timer->expire = 0;
+    timer->handler = handler;
+    timer->arg = arg;
+}
+
+/**
+ * @brief 启动定时器，已经启动的定时器会重新计时
+ *
+ * @param timer 定时器
+ * @param delay_ms 多少毫秒后到期
+ */
+void timer_add(net_timer_t *timer, uint64_t delay_ms)
+{
+    timer_cancel(timer);
+    timer->expire = timer_now() + delay_ms;
+    uint64_t tick = (timer->expire + TIMER_TICK_MS - 1) / TIMER_TICK_MS; // 向上取整，轮到该槽时一定已经到期
+    if (tick <= timer_tick)
+        tick = timer_tick + 1; // 已经处理过的槽要等下一圈，放到下一个tick
+    net_timer_t *head = &timer_wheel[tick % TIMER_WHEEL_SIZE];
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/**
+ * @brief 停止定时器，未启动的定时器不受影响
+ *
+ * @param timer 定时器
+ */
+void timer_cancel(net_timer_t *timer)
+{
+    if (!timer_pending(timer))
+        return;
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+/**
+ * @brief 推进时间轮，调用所有到期定时器的处理程序，由net_poll调用
+ *        处理程序中可以再启动或停止任意定时器
+ *
+ */
+void timer_poll()
+{
+    uint64_t now = timer_now();
+    uint64_t now_tick = now / TIMER_TICK_MS;
+    // 很久没有轮询时，每个槽走一遍就足够覆盖全部到期的定时器
+    if (now_tick - timer_tick > TIMER_WHEEL_SIZE)
+        timer_tick = now_tick - TIMER_WHEEL_SIZE;
+    net_timer_t expired; // 本槽到期的定时器，先一次摘到这里再调用处理程序
+    while (timer_tick < now_tick)
+    {
+        timer_tick++;
+        net_timer_t *head = &timer_wheel[timer_tick % TIMER_WHEEL_SIZE];
+        expired.prev = expired.next = &expired;
+        for (net_timer_t *timer = head->next, *next; timer != head; timer = next)
+        {
+            next = timer->next;
+            if (timer->expire > now)
+                continue;
+            timer->prev->next = next;
+            next->prev = timer->prev;
+            timer->prev = expired.prev;
+            timer->next = &expired;
+            expired.prev->next = timer;
+            expired.prev = timer;
+        }
+        // 仍挂在expired中的定时器照常可以停止或重新启动，被停止的不再调用，重新启动的挂回时间轮
+        while (expired.next != &expired)
+        {
+            net_timer_t *timer = expired.next;
+            timer_cancel(timer);
+            timer->handler(timer->arg);
+        }
+    }
+}
@@ -1,6 +1,10 @@
 #include "udp.h"
 #include "ip.h"
+#include "ipv6.h"
 #include "icmp.h"
+#include "icmpv6.h"
+#include "stats.h"
+#include "latency.h"
 
 /**
  * @brief udp处理程序表
@@ -8,6 +12,138 @@
  */
 map_t udp_table;
 
+/**
+ * @brief ipv6上的udp处理程序表，处理程序收到的src_ip为ipv6地址
+ * 
+ */
+map_t udp6_table;
+
+/**
+ * @brief 接收环中每个数据报前面的头部
+ * 
+ */
+typedef struct udp_dgram
+{
+    uint16_t len;                // 数据报长度
+    uint16_t src_port;           // 源端口号，与udp_handler_t一致为网络字节序
+    uint8_t src_ip[NET_IP6_LEN]; // 源ip地址，ipv4只用前NET_IP_LEN字节
+} udp_dgram_t;
+
+/**
+ * @brief 把收到的数据报交给端口：有处理程序时直接调用，否则放入接收环并产生可读事件
+ * 
+ * @param port 端口
+ * @param data 数据
+ * @param len 数据长度
+ * @param src_ip 源ip地址
+ * @param ip_len 源ip地址长度
+ * @param src_port 源端口号，网络字节序
+ */
+static void udp_deliver(udp_port_t *port, uint8_t *data, size_t len, uint8_t *src_ip, size_t ip_len, uint16_t src_port)
+{
+    if (port->handler) {
+        (*port->handler)(data, len, src_ip, src_port);
+        return;
+    }
+    if (ring_space(&port->rx_buf) < sizeof(udp_dgram_t) + len) {
+        stats_inc(STATS_UDP_DROP_QUEUE);
+        return;
+    }
+    udp_dgram_t dgram = {.len = len, .src_port = src_port};
+    memcpy(dgram.src_ip, src_ip, ip_len);
+    ring_write(&port->rx_buf, &dgram, sizeof(udp_dgram_t));
+    ring_write(&port->rx_buf, data, len);
+    event_post(&port->event, EVENT_READABLE);
+}
+
+/**
+ * @brief 关闭端口表中的一个端口，关注了该端口的应用层收到关闭事件
+ * 
+ * @param table 端口表
+ * @param port 端口号
+ */
+static void udp_table_close(map_t *table, uint16_t port)
+{
+    udp_port_t *entry = map_get(table, &port);
+    if (!entry)
+        return;
+    event_post(&entry->event, EVENT_CLOSED);
+    event_release(&entry->event);
+    ring_free(&entry->rx_buf);
+    map_delete(table, &port);
+}
+
+/**
+ * @brief 在端口表中打开一个端口，重复打开时先关闭原来的端口
+ * 
+ * @param table 端口表
+ * @param port 端口号
+ * @param handler 处理程序，NULL表示数据报由udp_recv取出
+ * @return int 成功为0，失败为-1
+ */
+static int udp_table_open(map_t *table, uint16_t port, udp_handler_t handler)
+{
+    udp_port_t entry = {.handler = handler};
+    udp_table_close(table, port);
+    if (!handler && ring_init(&entry.rx_buf, UDP_RCV_BUF_SIZE) != 0)
+        return -1;
+    if (map_set(table, &port, &entry) != 0) {
+        ring_free(&entry.rx_buf);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief 关注端口表中一个端口的就绪事件，udp端口总是可写
+ * 
+ * @param table 端口表
+ * @param port 端口号
+ * @param interest 关注的事件，0表示取消
+ * @param data 用户数据，随事件返回
+ * @return int 成功为0，端口没有打开为-1
+ */
+static int udp_table_watch(map_t *table, uint16_t port, uint8_t interest, void *data)
+{
+    udp_port_t *entry = map_get(table, &port);
+    if (!entry)
+        return -1;
+    uint8_t ready = EVENT_WRITABLE;
+    if (!entry->handler && ring_len(&entry->rx_buf))
+        ready |= EVENT_READABLE;
+    event_watch(&entry->event, interest, data, ready);
+    return 0;
+}
+
+/**
+ * @brief 从端口表中一个端口的接收环取出一个数据报
+ * 
+ * @param table 端口表
+ * @param port 端口号
+ * @param data 数据报，超出len的部分丢弃
+ * @param len data的大小
+ * @param src_ip 出口参数，源ip地址，可以为NULL
+ * @param ip_len 源ip地址长度
+ * @param src_port 出口参数，源端口号，网络字节序，可以为NULL
+ * @return int 数据报长度，没有数据报为-1
+ */
+static int udp_table_recv(map_t *table, uint16_t port, uint8_t *data, size_t len, uint8_t *src_ip, size_t ip_len, uint16_t *src_port)
+{
+    udp_port_t *entry = map_get(table, &port);
+    if (!entry || entry->handler || ring_len(&entry->rx_buf) == 0)
+        return -1;
+    udp_dgram_t dgram;
+    ring_read(&entry->rx_buf, &dgram, sizeof(udp_dgram_t));
+    uint32_t size = dgram.len < len ? dgram.len : len;
+    ring_read(&entry->rx_buf, data, size);
+    ring_consume(&entry->rx_buf, dgram.len - size);
+    if (src_ip)
+        memcpy(src_ip, dgram.src_ip, ip_len);
+    if (src_port)
+        *src_port = dgram.src_port;
+    return dgram.len;
+}
+
 /**
  * @brief udp伪校验和计算
  * 
@@ -64,35 +200,43 @@ static uint16_t udp_checksum(buf_t *buf, uint8_t *src_ip, uint8_t *dst_ip)
  */
 void udp_in(buf_t *buf, uint8_t *src_ip)
 {
+    LATENCY_MARK(LATENCY_STAGE_IP);
     // Step 1: Check the packet length
     if (buf->len < sizeof(udp_hdr_t)) {
+        stats_inc(STATS_UDP_DROP_SHORT);
         return;
     }
     udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
     if (buf->len < swap16(hdr->total_len16)) {
+        stats_inc(STATS_UDP_DROP_SHORT);
         return;
     }
+    stats_inc(STATS_UDP_RX);
     
     // Step 2: Check the checksum
     uint16_t checksum = hdr->checksum16;
     hdr->checksum16 = 0;
     if (checksum != udp_checksum(buf, src_ip, net_if_ip)) {
+        stats_inc(STATS_UDP_DROP_CHECKSUM);
         return;
     }
     hdr->checksum16 = checksum;
 
     // Step 3: Lookup the callback function for the destination port
     uint16_t dst_port16 = swap16(hdr->dst_port16);
-    udp_handler_t *cb = (udp_handler_t *)map_get(&udp_table, &dst_port16);
-    if (!cb) {
+    udp_port_t *entry = (udp_port_t *)map_get(&udp_table, &dst_port16);
+    if (!entry) {
         // Step 4: If the port is not found, send an ICMP unreachable packet
+        stats_inc(STATS_UDP_DROP_PORT);
         buf_add_header(buf, sizeof(ip_hdr_t));
         icmp_unreachable(buf, src_ip, ICMP_CODE_PORT_UNREACH);
         return;
     } else {
-        // Step 5: Otherwise, remove the header and call the callback function
+        // Step 5: Otherwise, remove the header and deliver the datagram to the port
         buf_remove_header(buf, sizeof(udp_hdr_t));
-        (*cb)(buf->data, buf->len, src_ip, hdr->src_port16);
+        LATENCY_MARK(LATENCY_STAGE_TRANSPORT);
+        udp_deliver(entry, buf->data, buf->len, src_ip, NET_IP_LEN, hdr->src_port16);
+        LATENCY_MARK(LATENCY_STAGE_HANDLER);
     }
 }
 
@@ -122,6 +266,7 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
     memcpy(buf->data, udp_hdr, sizeof(udp_hdr_t));
 
     // Step4: 调用ip_out()函数发送UDP数据报
+    stats_inc(STATS_UDP_TX);
     ip_out(buf, dst_ip, NET_PROTOCOL_UDP);
 }
 
@@ -131,20 +276,22 @@ void udp_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
  */
 void udp_init()
 {
-    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_handler_t), 0, 0, NULL);
+    map_init(&udp_table, sizeof(uint16_t), sizeof(udp_port_t), 0, 0, NULL);
+    map_init(&udp6_table, sizeof(uint16_t), sizeof(udp_port_t), 0, 0, NULL);
     net_add_protocol(NET_PROTOCOL_UDP, udp_in);
+    net_add_protocol(NET_IPV6_UPPER(NET_PROTOCOL_UDP), udp6_in);
 }
 
 /**
  * @brief 打开一个udp端口并注册处理程序
  * 
  * @param port 端口号
- * @param handler 处理程序
+ * @param handler 处理程序，NULL表示收到的数据报放入接收环，由udp_recv取出
  * @return int 成功为0，失败为-1
  */
 int udp_open(uint16_t port, udp_handler_t handler)
 {
-    return map_set(&udp_table, &port, &handler);
+    return udp_table_open(&udp_table, port, handler);
 }
 
 /**
@@ -154,7 +301,35 @@ int udp_open(uint16_t port, udp_handler_t handler)
  */
 void udp_close(uint16_t port)
 {
-    map_delete(&udp_table, &port);
+    udp_table_close(&udp_table, port);
+}
+
+/**
+ * @brief 关注一个udp端口的就绪事件，由event_get取出
+ * 
+ * @param port 端口号
+ * @param interest 关注的事件，0表示取消
+ * @param data 用户数据，随事件返回
+ * @return int 成功为0，端口没有打开为-1
+ */
+int udp_watch(uint16_t port, uint8_t interest, void *data)
+{
+    return udp_table_watch(&udp_table, port, interest, data);
+}
+
+/**
+ * @brief 从没有处理程序的udp端口取出一个数据报
+ * 
+ * @param port 端口号
+ * @param data 数据报，超出len的部分丢弃
+ * @param len data的大小
+ * @param src_ip 出口参数，源ip地址，可以为NULL
+ * @param src_port 出口参数，源端口号，网络字节序，可以为NULL
+ * @return int 数据报长度，没有数据报为-1
+ */
+int udp_recv(uint16_t port, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port)
+{
+    return udp_table_recv(&udp_table, port, data, len, src_ip, NET_IP_LEN, src_port);
 }
 
 /**
@@ -171,4 +346,135 @@ void udp_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, u
     buf_init(&txbuf, len);
     memcpy(txbuf.data, data, len);
     udp_out(&txbuf, src_port, dst_ip, dst_port);
+}
+
+/**
+ * @brief 处理一个收到的ipv6上的udp数据包
+ * 
+ * @param buf 要处理的包
+ * @param src_ip 源ipv6地址
+ */
+void udp6_in(buf_t *buf, uint8_t *src_ip)
+{
+    LATENCY_MARK(LATENCY_STAGE_IP);
+    if (buf->len < sizeof(udp_hdr_t) || buf->len < swap16(((udp_hdr_t *)buf->data)->total_len16)) {
+        stats_inc(STATS_UDP_DROP_SHORT);
+        return;
+    }
+    stats_inc(STATS_UDP_RX);
+    udp_hdr_t *hdr = (udp_hdr_t *)buf->data;
+
+    // ipv6中udp校验和是必需的，目的地址取自buf->data之前仍保留的ipv6头部
+    ipv6_hdr_t *ip_hdr = (ipv6_hdr_t *)(buf->data - sizeof(ipv6_hdr_t));
+    uint16_t checksum = hdr->checksum16;
+    hdr->checksum16 = 0;
+    uint16_t expect = ipv6_checksum(buf, src_ip, ip_hdr->dst_ip, NET_PROTOCOL_UDP);
+    if (checksum == 0 || checksum != (expect ? expect : 0xffff)) {
+        stats_inc(STATS_UDP_DROP_CHECKSUM);
+        return;
+    }
+    hdr->checksum16 = checksum;
+
+    uint16_t dst_port16 = swap16(hdr->dst_port16);
+    udp_port_t *entry = (udp_port_t *)map_get(&udp6_table, &dst_port16);
+    if (!entry) {
+        stats_inc(STATS_UDP_DROP_PORT);
+        if (!ipv6_is_multicast(ip_hdr->dst_ip)) {
+            buf_add_header(buf, sizeof(ipv6_hdr_t));
+            icmpv6_error(buf, src_ip, ICMPV6_TYPE_UNREACH, ICMPV6_CODE_PORT_UNREACH, 0);
+        }
+        return;
+    }
+    buf_remove_header(buf, sizeof(udp_hdr_t));
+    LATENCY_MARK(LATENCY_STAGE_TRANSPORT);
+    udp_deliver(entry, buf->data, buf->len, src_ip, NET_IP6_LEN, hdr->src_port16);
+    LATENCY_MARK(LATENCY_STAGE_HANDLER);
+}
+
+/**
+ * @brief 处理一个要发送的ipv6上的udp数据包
+ * 
+ * @param buf 要处理的包
+ * @param src_port 源端口号
+ * @param dst_ip 目的ipv6地址
+ * @param dst_port 目的端口号
+ */
+void udp6_out(buf_t *buf, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    buf_add_header(buf, sizeof(udp_hdr_t));
+    udp_hdr_t *udp_hdr = (udp_hdr_t *)buf->data;
+    udp_hdr->src_port16 = swap16(src_port);
+    udp_hdr->dst_port16 = dst_port;
+    udp_hdr->total_len16 = swap16(buf->len);
+    udp_hdr->checksum16 = 0;
+    uint16_t checksum = ipv6_checksum(buf, ipv6_src_for(dst_ip), dst_ip, NET_PROTOCOL_UDP);
+    udp_hdr->checksum16 = checksum ? checksum : 0xffff; // 0表示没有校验和，ipv6中用全1代替
+    stats_inc(STATS_UDP_TX);
+    ipv6_out(buf, dst_ip, NET_PROTOCOL_UDP);
+}
+
+/**
+ * @brief 打开一个ipv6上的udp端口并注册处理程序
+ * 
+ * @param port 端口号
+ * @param handler 处理程序，NULL表示收到的数据报放入接收环，由udp6_recv取出
+ * @return int 成功为0，失败为-1
+ */
+int udp6_open(uint16_t port, udp_handler_t handler)
+{
+    return udp_table_open(&udp6_table, port, handler);
+}
+
+/**
+ * @brief 关闭一个ipv6上的udp端口
+ * 
+ * @param port 端口号
+ */
+void udp6_close(uint16_t port)
+{
+    udp_table_close(&udp6_table, port);
+}
+
+/**
+ * @brief 关注一个ipv6上的udp端口的就绪事件，由event_get取出
+ * 
+ * @param port 端口号
+ * @param interest 关注的事件，0表示取消
+ * @param data 用户数据，随事件返回
+ * @return int 成功为0，端口没有打开为-1
+ */
+int udp6_watch(uint16_t port, uint8_t interest, void *data)
+{
+    return udp_table_watch(&udp6_table, port, interest, data);
+}
+
+/**
+ * @brief 从没有处理程序的ipv6上的udp端口取出一个数据报
+ * 
+ * @param port 端口号
+ * @param data 数据报，超出len的部分丢弃
+ * @param len data的大小
+ * @param src_ip 出口参数，源ip地址，可以为NULL
+ * @param src_port 出口参数，源端口号，网络字节序，可以为NULL
+ * @return int 数据报长度，没有数据报为-1
+ */
+int udp6_recv(uint16_t port, uint8_t *data, size_t len, uint8_t *src_ip, uint16_t *src_port)
+{
+    return udp_table_recv(&udp6_table, port, data, len, src_ip, NET_IP6_LEN, src_port);
+}
+
+/**
+ * @brief 发送一个ipv6上的udp包
+ * 
+ * @param data 要发送的数据
+ * @param len 数据长度
+ * @param src_port 源端口号
+ * @param dst_ip 目的ipv6地址
+ * @param dst_port 目的端口号
+ */
+void udp6_send(uint8_t *data, uint16_t len, uint16_t src_port, uint8_t *dst_ip, uint16_t dst_port)
+{
+    buf_init(&txbuf, len);
+    memcpy(txbuf.data, data, len);
+    udp6_out(&txbuf, src_port, dst_ip, dst_port);
 }
\ No newline at end of file
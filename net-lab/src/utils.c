@@ -1,6 +1,13 @@
+#ifdef _WIN32
+#define _CRT_RAND_S // rand_s由操作系统的随机数生成器提供
+#endif
 #include "utils.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef __linux__
+#include <sys/random.h>
+#endif
 /**
  * @brief ip转字符串
  * 
@@ -14,6 +21,21 @@ char *iptos(uint8_t *ip)
     return output;
 }
 
+/**
+ * @brief ipv6转字符串，不做零压缩
+ * 
+ * @param ip ipv6地址
+ * @return char* 生成的字符串
+ */
+char *ip6tos(uint8_t *ip)
+{
+    static char output[8 * 4 + 7 + 1];
+    sprintf(output, "%x:%x:%x:%x:%x:%x:%x:%x",
+            ip[0] << 8 | ip[1], ip[2] << 8 | ip[3], ip[4] << 8 | ip[5], ip[6] << 8 | ip[7],
+            ip[8] << 8 | ip[9], ip[10] << 8 | ip[11], ip[12] << 8 | ip[13], ip[14] << 8 | ip[15]);
+    return output;
+}
+
 /**
  * @brief mac转字符串
  * 
@@ -68,6 +90,108 @@ uint8_t ip_prefix_match(uint8_t *ipa, uint8_t *ipb)
     return count;
 }
 
+/**
+ * @brief 从操作系统取密码学强度的随机数，用于协议栈的密钥
+ *        Linux先用getrandom，其他类Unix系统读/dev/urandom，Windows用rand_s
+ * 
+ * @param buf 输出
+ * @param len 字节数
+ * @return int 成功为0，失败为-1
+ */
+int random_bytes(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+#ifdef _WIN32
+    while (len > 0) {
+        unsigned int r;
+        if (rand_s(&r) != 0)
+            return -1;
+        size_t n = len < sizeof(r) ? len : sizeof(r);
+        memcpy(p, &r, n);
+        p += n;
+        len -= n;
+    }
+    return 0;
+#else
+#ifdef __linux__
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n <= 0)
+            break; // 内核不支持等情况改读/dev/urandom
+        p += n;
+        len -= n;
+    }
+    if (len == 0)
+        return 0;
+#endif
+    FILE *f = fopen("/dev/urandom", "rb");
+    if (f == NULL)
+        return -1;
+    size_t n = fread(p, 1, len, f);
+    fclose(f);
+    return n == len ? 0 : -1;
+#endif
+}
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND(v0, v1, v2, v3)                                                      \
+    do {                                                                               \
+        v0 += v1; v1 = SIP_ROTL(v1, 13); v1 ^= v0; v0 = SIP_ROTL(v0, 32);              \
+        v2 += v3; v3 = SIP_ROTL(v3, 16); v3 ^= v2;                                     \
+        v0 += v3; v3 = SIP_ROTL(v3, 21); v3 ^= v0;                                     \
+        v2 += v1; v1 = SIP_ROTL(v1, 17); v1 ^= v2; v2 = SIP_ROTL(v2, 32);              \
+    } while (0)
+
+/**
+ * @brief 按小端序读8字节
+ * 
+ * @param p 数据
+ * @return uint64_t
+ */
+static inline uint64_t load64_le(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+/**
+ * @brief SipHash-2-4，带128位密钥的伪随机函数，对端不知道密钥时无法构造冲突或伪造散列值
+ * 
+ * @param key 16字节密钥
+ * @param data 数据
+ * @param len 长度
+ * @return uint64_t 散列值
+ */
+uint64_t siphash24(const uint8_t key[16], const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t k0 = load64_le(key), k1 = load64_le(key + 8);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    uint64_t b = (uint64_t)len << 56;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t m = load64_le(p);
+        v3 ^= m;
+        SIP_ROUND(v0, v1, v2, v3);
+        SIP_ROUND(v0, v1, v2, v3);
+        v0 ^= m;
+    }
+    for (size_t i = 0; i < len; i++)
+        b |= (uint64_t)p[i] << (8 * i);
+    v3 ^= b;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= b;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; i++)
+        SIP_ROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
 /**
  * @brief 计算16位校验和
  * 
@@ -89,4 +213,42 @@ uint16_t checksum16(uint16_t *data, size_t len)
         sum = (sum & 0xffff) + (sum >> 16);
     }
     return (uint16_t)~sum;
+}
+
+/**
+ * @brief 把一段数据累加到未折叠的16位校验和上，用于分段计算校验和
+ *        除最后一段外len必须是偶数
+ * 
+ * @param sum 之前的累加和
+ * @param data 数据
+ * @param len 长度
+ * @return uint32_t 新的累加和，还没有折叠和取反
+ */
+uint32_t checksum_add(uint32_t sum, const void *data, size_t len)
+{
+    const uint16_t *p = data;
+    while (len > 1) {
+        sum += *p++;
+        if (sum >> 31) // 防止长数据溢出
+            sum = (sum & 0xffff) + (sum >> 16);
+        len -= 2;
+    }
+    if (len) {
+        sum += *(const uint8_t *)p;
+    }
+    return sum;
+}
+
+/**
+ * @brief 折叠累加和并取反，得到16位校验和
+ * 
+ * @param sum checksum_add得到的累加和
+ * @return uint16_t 校验和
+ */
+uint16_t checksum_fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
 }
\ No newline at end of file
@@ -59,6 +59,11 @@ int driver_open()
         return 0;
 }
 
+int driver_update_filter()
+{
+        return 0;
+}
+
 int driver_recv(buf_t *buf)
 {
         struct pcap_pkthdr *pkt_hdr;
@@ -18,7 +18,7 @@ void ip_in(buf_t *buf, uint8_t *src_mac)
         fprint_buf(ip_fout, buf);
 }
 
-void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf)
+void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, uint16_t offset, int mf, int df)
 {
         fprintf(ip_fout,"ip_fragment_out:\n");        
         fprintf(ip_fout,"\tip: %s\n", print_ip(ip));
@@ -26,6 +26,7 @@ void ip_fragment_out(buf_t *buf, uint8_t *ip, net_protocol_t protocol, int id, u
         fprintf(ip_fout,"\tid: %d\n",id);
         fprintf(ip_fout,"\toffset: %d\n",offset);
         fprintf(ip_fout,"\tmf: %d\n",mf);
+        fprintf(ip_fout,"\tdf: %d\n",df);
         fprint_buf(ip_fout, buf);
 }
 
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "net.h"
+#include "ip.h"
+#include "utils.h"
+
+extern FILE *control_flow;
+extern FILE *arp_fout;
+
+FILE* open_file(char * path, char * name, char * mode);
+
+uint8_t dst_ip[NET_IP_LEN] = {192, 168, 163, 10};
+uint8_t payload[2000];
+size_t payload_len;
+
+void send_case(int i, size_t len)
+{
+        buf_t buf;
+        buf_init(&buf, len);
+        memcpy(buf.data, payload, len);
+        fprintf(control_flow,"\nCase %02d: pmtu %u, %zu bytes -----------------------------\n",i,ip_pmtu_get(dst_ip),len);
+        ip_out_df(&buf,dst_ip,NET_PROTOCOL_TCP);
+}
+
+int main(int argc, char* argv[])
+{
+        FILE *in = open_file(argv[1], "in.txt","r");
+        control_flow = open_file(argv[1], "log","w");
+        if(in == 0 || control_flow == 0){
+                if (in) fclose(in);
+                if (control_flow) fclose(control_flow);
+                return -1;
+        }
+        arp_fout = control_flow;
+        payload_len = fread(payload,1,sizeof(payload),in);
+        ip_init();
+        printf("\e[0;34mFeeding input.\n");
+        // 没有缓存时按网卡MTU发送，不分片的包带df位
+        send_case(1, 100);
+        // 需要分片报告的MTU不低于下限时照常记下，超长的包分片
+        ip_pmtu_update(dst_ip, 1000);
+        send_case(2, 100);
+        send_case(3, payload_len);
+        // 报告的MTU低于下限时只降到下限，并且不再设置df位
+        ip_pmtu_update(dst_ip, 300);
+        send_case(4, 100);
+        send_case(5, payload_len);
+        // 之后不低于下限的报告不会重新打开df位
+        ip_pmtu_update(dst_ip, IP_PMTU_MIN);
+        send_case(6, 100);
+
+        fclose(in);
+        fclose(control_flow);
+
+        FILE * demo = open_file(argv[1], "demo_log","r");
+        FILE * log = open_file(argv[1], "log","r");
+        int line = 1;
+        int column = 0;
+        int diff = 0;
+        char c1,c2;
+        printf("\e[0;34mComparing logs.\n");
+        while(fread(&c1,1,1,demo)){
+                column++;
+                if(fread(&c2,1,1,log) <= 0){
+                        printf("\e[0;31mLog file shorter than expected.\n");
+                        diff = 1;
+                        break;
+                }
+                if(c1 != c2){
+                        printf("\e[0;31mDifferent char found at line %d column %d.\n",line,column);
+                        diff = 1;
+                        break;
+                }
+                if(c1 == '\n'){
+                        line ++;
+                        column = 0;
+                }
+        }
+        if(diff == 0 && fread(&c2,1,1,log) == 1){
+                printf("\e[0;31mLog file longer than expected.\n");
+                diff = 1;
+        }
+        if(diff == 0){
+                printf("\e[1;32mLog file check passed\n");
+        }
+        fclose(log);
+        fclose(demo);
+        printf("\e[0m");
+        return diff ? -1 : 0;
+}
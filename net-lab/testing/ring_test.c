@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ring.h"
+
+extern FILE *control_flow;
+extern FILE *demo_log;
+extern FILE *out_log;
+
+int check_log();
+FILE* open_file(char * path, char * name, char * mode);
+
+ring_t ring;
+int round_num = 1;
+
+void new_round(const char *what)
+{
+        fprintf(control_flow,"\nRound %02d: %s -----------------------------\n",round_num++,what);
+}
+
+// 输出读写位置和从tail起的全部数据，位置是自由增长的计数，只在取模后定位
+void print_ring()
+{
+        char data[64];
+        uint32_t len = ring_len(&ring);
+        ring_peek(&ring, 0, data, len);
+        fprintf(control_flow,"head:%u tail:%u len:%u space:%u data:\"%.*s\"\n",
+                ring.head,ring.tail,len,ring_space(&ring),(int)len,data);
+}
+
+void write_case(const char *src)
+{
+        uint32_t n = ring_write(&ring, src, strlen(src));
+        fprintf(control_flow,"write \"%s\": %u\n",src,n);
+        print_ring();
+}
+
+void read_case(uint32_t len)
+{
+        char data[64];
+        uint32_t n = ring_read(&ring, data, len);
+        fprintf(control_flow,"read %u: \"%.*s\"\n",len,(int)n,data);
+        print_ring();
+}
+
+int main(int argc, char* argv[])
+{
+        control_flow = open_file(argv[1], "log","w");
+        if(control_flow == 0){
+                printf("\e[1;31mFailed to open log\n\e[0m");
+                return -1;
+        }
+        ring_init(&ring, 8);
+        printf("\e[0;34mFeeding input.\n");
+
+        new_round("write and read without wrapping");
+        write_case("abcdef");
+        read_case(4);
+
+        new_round("write across the end of storage");
+        // 只剩6字节空间，写入时分成末尾2字节和开头4字节两段
+        write_case("ghijklmn");
+        write_case("z");
+
+        new_round("peek across the end of storage");
+        char data[8];
+        ring_peek(&ring, 1, data, 4);
+        fprintf(control_flow,"peek 1+4: \"%.4s\"\n",data);
+        print_ring();
+
+        new_round("read across the end of storage");
+        read_case(5);
+        read_case(8);
+
+        new_round("out of order write across the end");
+        // 乱序数据先写在已有数据之后2字节处，跨过存储区末尾，补齐空洞后一起提交
+        write_case("a");
+        ring_write_at(&ring, 2, "DEFG", 4);
+        fprintf(control_flow,"write_at 2 \"DEFG\"\n");
+        print_ring();
+        ring_write_at(&ring, 0, "BC", 2);
+        ring_commit(&ring, 6);
+        fprintf(control_flow,"write_at 0 \"BC\", commit 6\n");
+        print_ring();
+        ring_consume(&ring, 3);
+        fprintf(control_flow,"consume 3\n");
+        print_ring();
+
+        new_round("positions wrap around 2^32");
+        ring.head = ring.tail = UINT32_MAX - 2;
+        write_case("uvwxyz");
+        read_case(4);
+        write_case("0123");
+        read_case(8);
+
+        new_round("reset and free");
+        write_case("abc");
+        ring_reset(&ring);
+        fprintf(control_flow,"reset\n");
+        print_ring();
+        ring_free(&ring);
+        fprintf(control_flow,"free: size:%u data:%s\n",ring.size,ring.data ? "set" : "null");
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        if(demo_log == 0 || out_log == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+        int ret = check_log();
+        fclose(demo_log);
+        fclose(out_log);
+        return ret ? -1 : 0;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+
+// SYN cookie的编解码是tcp.c内部的函数，直接包含源文件来测试
+#include "../src/tcp.c"
+
+extern FILE *control_flow;
+extern FILE *demo_log;
+extern FILE *out_log;
+
+int check_log();
+FILE* open_file(char * path, char * name, char * mode);
+
+tcp_key_t key = {
+        .ip = {192, 168, 163, 10},
+        .local_ip = {192, 168, 163, 103},
+        .src_port = 50000,
+        .dst_port = 61000,
+        .version = IP_VERSION_4,
+};
+int round_num = 1;
+
+void new_round(const char *what)
+{
+        fprintf(control_flow,"\nRound %02d: %s -----------------------------\n",round_num++,what);
+}
+
+// cookie本身取决于随机密钥和当前时间，日志只记录校验结果和其中的MSS
+void check_case(const char *what, const tcp_key_t *k, uint32_t irs, uint32_t cookie)
+{
+        uint16_t mss = 0;
+        int ret = tcp_cookie_check(k, irs, cookie, &mss);
+        fprintf(control_flow,"%s: %d mss:%u\n",what,ret,ret == 0 ? mss : 0);
+}
+
+// 用指定时间片构造cookie，模拟之前或之后生成的cookie
+uint32_t cookie_at(int slot_diff, uint32_t irs, uint32_t m)
+{
+        uint32_t t = (tcp_cookie_time() + slot_diff) & 0x1f;
+        return t << 27 | m << 24 | (tcp_cookie_hash(&key, irs, t, m) & 0xffffff);
+}
+
+int main(int argc, char* argv[])
+{
+        control_flow = open_file(argv[1], "log","w");
+        if(control_flow == 0){
+                printf("\e[1;31mFailed to open log\n\e[0m");
+                return -1;
+        }
+        random_bytes(syn_secret, sizeof(syn_secret));
+        printf("\e[0;34mFeeding input.\n");
+
+        new_round("mss is rounded down to an encodable value");
+        uint16_t peer_mss[] = {100, 536, 1000, 1399, 1460, 9000};
+        for(size_t i = 0; i < sizeof(peer_mss) / sizeof(peer_mss[0]); i++){
+                uint16_t mss = peer_mss[i];
+                uint32_t cookie = tcp_cookie_make(&key, 1000, &mss);
+                fprintf(control_flow,"peer mss %u: encoded %u index %u\n",peer_mss[i],mss,cookie >> 24 & 0x7);
+        }
+
+        new_round("cookie decodes for the same connection only");
+        uint16_t mss = 1400;
+        uint32_t irs = 0xfffffff0; // 对端初始序号取值不影响校验
+        uint32_t cookie = tcp_cookie_make(&key, irs, &mss);
+        check_case("same key and irs", &key, irs, cookie);
+        check_case("other irs", &key, irs + 1, cookie);
+        tcp_key_t other = key;
+        other.src_port++;
+        check_case("other port", &other, irs, cookie);
+        other = key;
+        other.ip[3]++;
+        check_case("other address", &other, irs, cookie);
+        check_case("hash bit flipped", &key, irs, cookie ^ 1);
+        check_case("mss index changed", &key, irs, cookie ^ 1 << 24);
+
+        new_round("only the current and previous time slots are accepted");
+        check_case("current slot", &key, irs, cookie_at(0, irs, 3));
+        check_case("previous slot", &key, irs, cookie_at(-1, irs, 3));
+        check_case("two slots ago", &key, irs, cookie_at(-2, irs, 3));
+        check_case("next slot", &key, irs, cookie_at(1, irs, 3));
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        if(demo_log == 0 || out_log == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+        int ret = check_log();
+        fclose(demo_log);
+        fclose(out_log);
+        return ret ? -1 : 0;
+}
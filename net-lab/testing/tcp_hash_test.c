@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "tcp_hash.h"
+
+extern FILE *control_flow;
+extern FILE *demo_log;
+extern FILE *out_log;
+
+int check_log();
+FILE* open_file(char * path, char * name, char * mode);
+
+typedef struct obj {
+        char name;
+        uint32_t key;
+        uint32_t hash; // 由测试指定，用来构造聚集和回绕
+        int in_table;
+} obj_t;
+
+obj_t objs[] = {
+        {'a', 1, 6}, {'b', 2, 6}, {'c', 3, 7}, {'d', 4, 7}, {'e', 5, 0},
+        {'f', 6, 2}, {'g', 7, 3}, {'h', 8, 2}, {'i', 9, 14}, {'j', 10, 6},
+};
+#define OBJ_NUM (sizeof(objs) / sizeof(objs[0]))
+
+tcp_hash_t table;
+int round_num = 1;
+
+void new_round(const char *what)
+{
+        fprintf(control_flow,"\nRound %02d: %s -----------------------------\n",round_num++,what);
+}
+
+// 输出每个槽中的对象和它的理想位置，再确认表中每个对象都还能查到，不在表中的查不到
+void print_table()
+{
+        fprintf(control_flow,"size:%u num:%u\n",table.mask + 1,table.num);
+        for(uint32_t i = 0; i <= table.mask; i++){
+                obj_t *obj = table.slots[i].obj;
+                if(obj)
+                        fprintf(control_flow,"\tslot %2u: %c home %u\n",i,obj->name,obj->hash & table.mask);
+        }
+        fprintf(control_flow,"lookup:");
+        for(size_t i = 0; i < OBJ_NUM; i++){
+                obj_t *found = tcp_hash_get(&table, &objs[i].key, objs[i].hash);
+                if(objs[i].in_table ? found == &objs[i] : found == NULL)
+                        fprintf(control_flow," %c%s",objs[i].name,objs[i].in_table ? "+" : "-");
+                else
+                        fprintf(control_flow," %c!",objs[i].name);
+        }
+        fprintf(control_flow,"\n");
+}
+
+void add(char name)
+{
+        obj_t *obj = &objs[name - 'a'];
+        int ret = tcp_hash_add(&table, obj, obj->hash);
+        obj->in_table = ret == 0;
+        fprintf(control_flow,"add %c: %d\n",name,ret);
+}
+
+void del(char name)
+{
+        obj_t *obj = &objs[name - 'a'];
+        tcp_hash_remove(&table, obj, obj->hash);
+        obj->in_table = 0;
+        fprintf(control_flow,"remove %c\n",name);
+}
+
+int main(int argc, char* argv[])
+{
+        control_flow = open_file(argv[1], "log","w");
+        if(control_flow == 0){
+                printf("\e[1;31mFailed to open log\n\e[0m");
+                return -1;
+        }
+        tcp_hash_init(&table, 8, offsetof(obj_t, key), sizeof(uint32_t));
+        printf("\e[0;34mFeeding input.\n");
+
+        new_round("cluster wraps around the end of the table");
+        add('a');
+        add('b');
+        add('c');
+        add('d');
+        add('e');
+        print_table();
+
+        new_round("remove the head of a wrapped cluster");
+        // b、c、d、e依次前移一格，d从槽1回绕到槽0
+        del('a');
+        print_table();
+
+        new_round("shift back onto the home slot");
+        // e前移回到理想位置0，槽7中的c就在理想位置，不受影响
+        del('d');
+        print_table();
+
+        new_round("remove from the middle of a cluster");
+        add('f');
+        add('g');
+        add('h');
+        print_table();
+        // g就在理想位置3，不动；h的理想位置是2，越过g前移到槽2
+        del('f');
+        print_table();
+
+        new_round("remove an object that is not in the table");
+        del('f');
+        print_table();
+
+        new_round("grow past 3/4 load keeps every object reachable");
+        add('a');
+        add('d');
+        add('f');
+        add('i');
+        add('j');
+        print_table();
+        del('b');
+        del('j');
+        print_table();
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        if(demo_log == 0 || out_log == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+        int ret = check_log();
+        fclose(demo_log);
+        fclose(out_log);
+        return ret ? -1 : 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <string.h>
+
+// tcp_range_insert是tcp.c内部的函数，直接包含源文件来测试
+#include "../src/tcp.c"
+
+extern FILE *control_flow;
+extern FILE *demo_log;
+extern FILE *out_log;
+
+int check_log();
+FILE* open_file(char * path, char * name, char * mode);
+
+#define RANGE_MAX 4
+
+tcp_range_t ranges[RANGE_MAX];
+uint8_t range_num;
+int round_num = 1;
+
+void new_round(const char *what)
+{
+        fprintf(control_flow,"\nRound %02d: %s -----------------------------\n",round_num++,what);
+        range_num = 0;
+}
+
+// 区间按相对base的序号输出，便于观察序号回绕时的情况
+void insert_case(uint32_t base, uint32_t start, uint32_t end)
+{
+        int ret = tcp_range_insert(ranges, &range_num, RANGE_MAX, base + start, base + end);
+        fprintf(control_flow,"insert [%u,%u): %d ->",start,end,ret);
+        for(int i = 0; i < range_num; i++)
+                fprintf(control_flow," [%u,%u)",ranges[i].start - base,ranges[i].end - base);
+        fprintf(control_flow,"\n");
+}
+
+int main(int argc, char* argv[])
+{
+        control_flow = open_file(argv[1], "log","w");
+        if(control_flow == 0){
+                printf("\e[1;31mFailed to open log\n\e[0m");
+                return -1;
+        }
+        printf("\e[0;34mFeeding input.\n");
+
+        new_round("disjoint ranges are kept sorted");
+        insert_case(0, 300, 400);
+        insert_case(0, 100, 200);
+        insert_case(0, 500, 600);
+        insert_case(0, 0, 50);
+
+        new_round("adjacent ranges merge");
+        insert_case(0, 100, 200);
+        insert_case(0, 300, 400);
+        insert_case(0, 200, 300);
+        insert_case(0, 50, 100);
+        insert_case(0, 400, 450);
+
+        new_round("overlap extends one range");
+        insert_case(0, 100, 200);
+        insert_case(0, 150, 250);
+        insert_case(0, 50, 120);
+        insert_case(0, 120, 180);
+
+        new_round("one range swallows several");
+        insert_case(0, 100, 200);
+        insert_case(0, 300, 400);
+        insert_case(0, 500, 600);
+        insert_case(0, 700, 800);
+        insert_case(0, 150, 550);
+        insert_case(0, 0, 1000);
+
+        new_round("full table rejects only a new range");
+        insert_case(0, 100, 200);
+        insert_case(0, 300, 400);
+        insert_case(0, 500, 600);
+        insert_case(0, 700, 800);
+        insert_case(0, 900, 1000);
+        insert_case(0, 350, 450);
+        insert_case(0, 200, 300);
+        insert_case(0, 900, 1000);
+
+        new_round("sequence numbers wrap around 2^32");
+        // 区间跨过序号0，按序号先后而不是数值大小合并
+        insert_case(UINT32_MAX - 99, 0, 50);
+        insert_case(UINT32_MAX - 99, 150, 200);
+        insert_case(UINT32_MAX - 99, 40, 160);
+        insert_case(UINT32_MAX - 99, 300, 400);
+        fprintf(control_flow,"absolute: [%u,%u) [%u,%u)\n",
+                ranges[0].start,ranges[0].end,ranges[1].start,ranges[1].end);
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        if(demo_log == 0 || out_log == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+        int ret = check_log();
+        fclose(demo_log);
+        fclose(out_log);
+        return ret ? -1 : 0;
+}
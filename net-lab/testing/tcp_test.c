@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <string.h>
+#include "driver.h"
+#include "ethernet.h"
+#include "tcp.h"
+
+extern FILE *pcap_in;
+extern FILE *pcap_out;
+extern FILE *pcap_demo;
+extern FILE *control_flow;
+extern FILE *demo_log;
+extern FILE *out_log;
+
+int check_log();
+int check_pcap();
+FILE* open_file(char * path, char * name, char * mode);
+
+char* state_names[] = {
+        [TCP_CONN_CONNECTED] "connected",
+        [TCP_CONN_DATA_RECV] "data recv",
+        [TCP_CONN_CLOSED] "closed",
+};
+
+// 回显收到的数据；关闭Nagle，回显不等对端确认前一次回显就发出
+void handler(tcp_connect_t* connect, connect_state_t state)
+{
+        uint8_t data[64];
+        fprintf(control_flow,"handler: %s\n",state_names[state]);
+        if(state == TCP_CONN_CONNECTED)
+                tcp_connect_set_nodelay(connect, 1);
+        if(state != TCP_CONN_DATA_RECV)
+                return;
+        size_t len = tcp_connect_read(connect, data, sizeof(data));
+        fprintf(control_flow,"\tread: \"%.*s\"\n",(int)len,data);
+        tcp_connect_write(connect, data, len);
+}
+
+buf_t buf;
+int main(int argc, char* argv[]){
+        int ret;
+        printf("\e[0;34mTest begin.\n");
+        pcap_in = open_file(argv[1], "in.pcap","r");
+        pcap_out = open_file(argv[1], "out.pcap","w");
+        control_flow = open_file(argv[1], "log","w");
+        if(pcap_in == 0 || pcap_out == 0 || control_flow == 0){
+                if(pcap_in) fclose(pcap_in); else printf("\e[1;31mFailed to open in.pcap\n");
+                if(pcap_out)fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n");
+                if(control_flow) fclose(control_flow); else printf("\e[1;31mFailed to open log\n");
+                printf("\e[0m");
+                return -1;
+        }
+
+        net_init();
+        tcp_open(61000, handler);
+        int i = 1;
+        printf("\e[0;34mFeeding input %02d",i);
+        // 输入依次为：ARP请求、握手、先到的第二段、补齐空缺的第一段、对端重传的第一段（本端的确认丢失）、
+        // 新数据（对端对回显的确认丢失）、覆盖两次回显的累积确认、对端关闭
+        while((ret = driver_recv(&buf)) > 0){
+                printf("\b\b%02d",i);
+                fprintf(control_flow,"\nRound %02d -----------------------------\n",i++);
+                ethernet_in(&buf);
+                tcp_flush_acks(); // 与net_poll一样，一批收包处理完后再发出确认
+        }
+        if(ret < 0){
+                fprintf(stderr,"\e[1;31m\nError occur on loading input,exiting\n");
+        }
+        driver_close();
+        printf("\e[0;34m\nSample input all processed, checking output\n");
+
+        fclose(control_flow);
+
+        demo_log = open_file(argv[1], "demo_log","r");
+        out_log = open_file(argv[1], "log","r");
+        pcap_out = open_file(argv[1], "out.pcap","r");
+        pcap_demo = open_file(argv[1], "demo_out.pcap","r");
+        if(demo_log == 0 || out_log == 0 || pcap_out == 0 || pcap_demo == 0){
+                if(demo_log) fclose(demo_log); else printf("\e[1;31mFailed to open demo_log\n");
+                if(out_log) fclose(out_log); else printf("\e[1;31mFailed to open log\n");
+                if(pcap_demo) fclose(pcap_demo); else printf("\e[1;31mFailed to open demo_out.pcap\n");
+                if(pcap_out) fclose(pcap_out); else printf("\e[1;31mFailed to open out.pcap\n");
+                printf("\e[0m");
+                return -1;
+        }
+        ret = check_log();
+        ret = check_pcap() || ret;
+        fclose(demo_log);
+        fclose(out_log);
+        return ret ? -1 : 0;
+}